@@ -0,0 +1,189 @@
+#!/usr/bin/env python3
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+# Usage: rr-perf-bench.py [--rr=<rr>] [--bin-dir=<dir>] [--baseline=<json>]
+#                         [--output=<json>] [--repeat=N] [--tolerance=F]
+#                         [--large-memory-mb=N] [workload...]
+#
+# Records and replays each workload from src/perf-test (built into <dir> by
+# `make perf-test-programs`) and reports wall time, peak RSS, trace events,
+# events/sec and trace bytes per event for each phase as JSON. If a baseline
+# produced by an earlier run is given, any metric that got worse by more
+# than the tolerance is reported and the script exits with status 1.
+# See src/perf-test/perf-test.md.
+
+REPLAY_PHASES = ['record', 'replay', 'replay-fast']
+
+# name -> (program, phases)
+WORKLOADS = {
+    'exec-churn': ('exec-churn', REPLAY_PHASES),
+    'unbuffered-syscalls': ('unbuffered-syscalls', REPLAY_PHASES),
+    'many-threads': ('many-threads', REPLAY_PHASES),
+    'mmap-churn': ('mmap-churn', REPLAY_PHASES),
+    'signals': ('signals', REPLAY_PHASES),
+    'large-memory': ('large-memory', REPLAY_PHASES),
+    'reverse-exec': ('unbuffered-syscalls', ['record', 'reverse-exec']),
+}
+
+# metric -> True if bigger is better
+METRICS = {
+    'wall_seconds': False,
+    'peak_rss_kb': False,
+    'events_per_sec': True,
+    'trace_bytes_per_event': False,
+}
+
+def run_measured(cmd):
+    """Run cmd and return (wall seconds, peak RSS in KB of it and its
+    descendants)."""
+    with tempfile.TemporaryFile() as stderr:
+        start = time.monotonic()
+        proc = subprocess.Popen(cmd, stdin=subprocess.DEVNULL,
+                                stdout=subprocess.DEVNULL, stderr=stderr)
+        _, status, rusage = os.wait4(proc.pid, 0)
+        wall = time.monotonic() - start
+        proc.returncode = os.waitstatus_to_exitcode(status)
+        if proc.returncode != 0:
+            stderr.seek(0)
+            sys.stderr.write(stderr.read().decode(errors='replace'))
+            raise RuntimeError('%s failed with status %d' %
+                               (' '.join(cmd), proc.returncode))
+    return (wall, rusage.ru_maxrss)
+
+def trace_bytes(trace_dir):
+    total = 0
+    for dirpath, _, filenames in os.walk(trace_dir):
+        for f in filenames:
+            total += os.lstat(os.path.join(dirpath, f)).st_size
+    return total
+
+def trace_events(rr, trace_dir):
+    out = subprocess.check_output([rr, 'dump', '-r', trace_dir, 'end'],
+                                  stderr=subprocess.DEVNULL).decode()
+    lines = [l for l in out.splitlines() if l.strip()]
+    return int(lines[-1].split()[0])
+
+def phase_command(rr, phase, trace_dir, program, program_args):
+    if phase == 'record':
+        return [rr, 'record', '-o', trace_dir, program] + program_args
+    if phase == 'replay':
+        return [rr, 'replay', '-a', trace_dir]
+    if phase == 'replay-fast':
+        return [rr, 'replay', '-a', '--fast', trace_dir]
+    # Run forward to the end of the recording, then reverse-execute all the
+    # way back, which exercises checkpoint creation and restoration.
+    return [rr, 'replay', trace_dir, '--', '-batch', '-nx',
+            '-ex', 'continue', '-ex', 'reverse-continue']
+
+def run_workload(rr, bin_dir, name, repeat, work_dir, program_args):
+    program_name, phases = WORKLOADS[name]
+    program = os.path.join(bin_dir, program_name)
+    if not os.access(program, os.X_OK):
+        raise RuntimeError('%s not found; run `make perf-test-programs`' %
+                           program)
+    if 'reverse-exec' in phases and not shutil.which('gdb'):
+        print('Skipping %s: gdb not found' % name, file=sys.stderr)
+        return None
+    trace_dir = os.path.join(work_dir, name)
+    results = {}
+    for phase in phases:
+        best = None
+        for _ in range(repeat):
+            if phase == 'record':
+                shutil.rmtree(trace_dir, ignore_errors=True)
+            wall, rss = run_measured(
+                phase_command(rr, phase, trace_dir, program, program_args))
+            if best is None or wall < best[0]:
+                best = (wall, rss)
+        results[phase] = {'wall_seconds': best[0], 'peak_rss_kb': best[1]}
+    events = trace_events(rr, trace_dir)
+    total_bytes = trace_bytes(trace_dir)
+    for r in results.values():
+        r['events'] = events
+        r['events_per_sec'] = events / r['wall_seconds']
+        r['trace_bytes_per_event'] = total_bytes / max(events, 1)
+    shutil.rmtree(trace_dir, ignore_errors=True)
+    return results
+
+def compare(baseline, results, tolerance):
+    regressions = []
+    for name, phases in results.items():
+        for phase, metrics in phases.items():
+            old = baseline.get(name, {}).get(phase)
+            if not old:
+                continue
+            for metric, bigger_is_better in METRICS.items():
+                if metric not in old or not old[metric]:
+                    continue
+                change = metrics[metric] / old[metric] - 1
+                if bigger_is_better:
+                    change = -change
+                if change > tolerance:
+                    regressions.append('%s %s %s: %.4g -> %.4g (%.1f%% worse)' %
+                                       (name, phase, metric, old[metric],
+                                        metrics[metric], change * 100))
+    return regressions
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Benchmark rr record/replay performance.')
+    parser.add_argument('--rr', default=shutil.which('rr') or 'bin/rr')
+    parser.add_argument('--bin-dir', default='bin')
+    parser.add_argument('--baseline')
+    parser.add_argument('--output')
+    parser.add_argument('--repeat', type=int, default=3)
+    parser.add_argument('--tolerance', type=float, default=0.1)
+    parser.add_argument('--large-memory-mb', type=int, default=512,
+                        help='heap size of the large-memory workload')
+    parser.add_argument('workloads', nargs='*',
+                        default=sorted(WORKLOADS.keys()))
+    args = parser.parse_args()
+
+    for name in args.workloads:
+        if name not in WORKLOADS:
+            parser.error('Unknown workload %s' % name)
+
+    results = {}
+    work_dir = tempfile.mkdtemp(prefix='rr-perf-bench-')
+    try:
+        for name in args.workloads:
+            program_args = []
+            if name == 'large-memory':
+                program_args = [str(args.large_memory_mb)]
+            r = run_workload(args.rr, args.bin_dir, name, args.repeat,
+                             work_dir, program_args)
+            if r is not None:
+                results[name] = r
+    finally:
+        shutil.rmtree(work_dir, ignore_errors=True)
+
+    output = json.dumps(results, indent=2, sort_keys=True)
+    if args.output:
+        with open(args.output, 'w') as f:
+            f.write(output + '\n')
+    else:
+        print(output)
+
+    if args.baseline and not os.path.exists(args.baseline):
+        print('No baseline %s, not comparing' % args.baseline,
+              file=sys.stderr)
+    elif args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+        regressions = compare(baseline, results, args.tolerance)
+        for r in regressions:
+            print('REGRESSION: %s' % r, file=sys.stderr)
+        if regressions:
+            return 1
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
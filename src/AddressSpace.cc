@@ -1372,25 +1372,99 @@ void AddressSpace::advise(Task*, remote_ptr<void> addr, ssize_t num_bytes,
     case MADV_KEEPONFORK:
       remove_range(wipe_on_fork, MemoryRange(addr, num_bytes));
       break;
+    case MADV_DONTNEED:
+    case MADV_REMOVE:
+      if (soft_dirty_cleared) {
+        add_range(discarded_since_clear_soft_dirty,
+                  MemoryRange(addr, num_bytes));
+      }
+      break;
     default:
       break;
   }
 }
 
+bool AddressSpace::clear_soft_dirty(Task* t) {
+  soft_dirty_cleared = false;
+  discarded_since_clear_soft_dirty.clear();
+  if (!soft_dirty_works()) {
+    return false;
+  }
+  char path[PATH_MAX];
+  sprintf(path, "/proc/%d/clear_refs", t->tid);
+  ScopedFd fd(path, O_WRONLY);
+  if (!fd.is_open() || write(fd, "4", 1) != 1) {
+    LOG(warn) << "Can't clear soft-dirty bits via " << path;
+    return false;
+  }
+  soft_dirty_cleared = true;
+  return true;
+}
+
+bool AddressSpace::may_have_changed_since_clear_soft_dirty(
+    Task* t, const MemoryRange& range) {
+  if (!soft_dirty_cleared) {
+    return true;
+  }
+  auto discarded = discarded_since_clear_soft_dirty.lower_bound(range);
+  if (discarded != discarded_since_clear_soft_dirty.begin()) {
+    --discarded;
+  }
+  for (; discarded != discarded_since_clear_soft_dirty.end() &&
+         discarded->start() < range.end(); ++discarded) {
+    if (discarded->intersects(range)) {
+      return true;
+    }
+  }
+
+  ScopedFd pagemap(t->proc_pagemap_path().c_str(), O_RDONLY);
+  if (!pagemap.is_open()) {
+    return true;
+  }
+  uint64_t entries[4096];
+  uint64_t page = range.start().as_int() / page_size();
+  uint64_t end_page = ceil_page_size(range.end().as_int()) / page_size();
+  while (page < end_page) {
+    size_t count = min<uint64_t>(end_page - page, array_length(entries));
+    ssize_t ret = pread(pagemap, entries, count * sizeof(entries[0]),
+                        page * sizeof(entries[0]));
+    if (ret <= 0 || ret % sizeof(entries[0])) {
+      return true;
+    }
+    size_t read_count = ret / sizeof(entries[0]);
+    for (size_t i = 0; i < read_count; ++i) {
+      if (entries[i] & PAGEMAP_SOFT_DIRTY) {
+        return true;
+      }
+    }
+    page += read_count;
+  }
+  return false;
+}
+
 void AddressSpace::did_fork_into(Task* t) {
   // MADV_WIPEONFORK is inherited across fork and cleared on exec.
   // We'll copy it here, then do the `dont_fork` unmappings, and then
   // whatever survives in the new AddressSpace's wipe_on_fork gets wiped.
   t->vm()->wipe_on_fork = wipe_on_fork;
 
-  for (auto& range : dont_fork) {
-    // During recording we execute MADV_DONTFORK so the forked child will
-    // have had its dontfork areas unmapped by the kernel already
-    if (!t->session().is_recording()) {
-      AutoRemoteSyscalls remote(t);
-      remote.infallible_syscall(syscall_number_for_munmap(remote.arch()),
-                                range.start(), range.size());
+  // During recording we execute MADV_DONTFORK so the forked child will
+  // have had its dontfork areas unmapped by the kernel already
+  if (!t->session().is_recording() && !dont_fork.empty()) {
+    AutoRemoteSyscalls remote(t);
+    int munmap_syscallno = syscall_number_for_munmap(remote.arch());
+    vector<AutoRemoteSyscalls::BatchedSyscall> munmaps;
+    for (auto& range : dont_fork) {
+      munmaps.push_back(AutoRemoteSyscalls::BatchedSyscall(
+          munmap_syscallno, range.start().as_int(), range.size()));
     }
+    size_t executed = remote.syscall_batch(munmaps);
+    for (size_t i = 0; i < munmaps.size(); ++i) {
+      remote.check_syscall_result(i < executed ? munmaps[i].result : -ESRCH,
+                                  munmap_syscallno, false);
+    }
+  }
+  for (auto& range : dont_fork) {
     t->vm()->unmap(t, range.start(), range.size());
   }
 
@@ -1674,6 +1748,7 @@ AddressSpace::AddressSpace(Task* t, const string& exe, uint32_t exec_count)
       leader_tid_(t->rec_tid),
       leader_serial(t->tuid().serial()),
       exec_count(exec_count),
+      soft_dirty_cleared(false),
       session_(&t->session()),
       monkeypatch_state(t->session().is_recording() ? new Monkeypatcher()
                                                     : nullptr),
@@ -1709,6 +1784,7 @@ AddressSpace::AddressSpace(Session* session, const AddressSpace& o,
       monitored_mem(o.monitored_mem),
       dont_fork(o.dont_fork),
       wipe_on_fork(o.wipe_on_fork),
+      soft_dirty_cleared(false),
       session_(session),
       vdso_start_addr(o.vdso_start_addr),
       monkeypatch_state(o.monkeypatch_state
@@ -658,6 +658,33 @@ public:
    */
   void advise(Task* t, remote_ptr<void> addr, ssize_t num_bytes, int advice);
 
+  /**
+   * Clear the kernel's soft-dirty bits for all pages of this address space,
+   * starting a new interval for may_have_changed_since_clear_soft_dirty().
+   * Returns false if soft-dirty tracking isn't available.
+   */
+  bool clear_soft_dirty(Task* t);
+  /**
+   * Returns false only if no page in `range` can have changed since the
+   * last successful clear_soft_dirty(). Soft-dirty bits don't see writes
+   * through other mappings of the same memory, so `range` must be private
+   * anonymous memory.
+   */
+  bool may_have_changed_since_clear_soft_dirty(Task* t,
+                                                const MemoryRange& range);
+
+  struct CachedChecksum {
+    KernelMapping map;
+    uint32_t checksum;
+  };
+  /**
+   * Per-mapping memory checksums from the last checksum_process_memory()
+   * or validate_process_memory() call, keyed by mapping start.
+   */
+  std::map<remote_ptr<void>, CachedChecksum>& cached_checksums() {
+    return cached_checksums_;
+  }
+
   /** Return the vdso mapping of this. */
   KernelMapping vdso() const;
   bool has_vdso() const { return has_mapping(vdso_start_addr); }
@@ -1142,6 +1169,12 @@ private:
   std::set<MemoryRange> dont_fork;
   /* madvise WIPEONFORK regions */
   std::set<MemoryRange> wipe_on_fork;
+  /* True if clear_soft_dirty() succeeded for this address space. */
+  bool soft_dirty_cleared;
+  /* Regions discarded by madvise since the last clear_soft_dirty(). Their
+   * pages read as zero but aren't soft-dirty. */
+  std::set<MemoryRange> discarded_since_clear_soft_dirty;
+  std::map<remote_ptr<void>, CachedChecksum> cached_checksums_;
   // The session that created this.  We save a ref to it so that
   // we can notify it when we die.
   Session* session_;
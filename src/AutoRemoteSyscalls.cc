@@ -447,6 +447,165 @@ long AutoRemoteSyscalls::syscall_base(int syscallno, Registers& callregs) {
   }
 }
 
+/* Must match the syscall_batch stub in rr_page_instructions.S */
+struct syscall_batch_entry {
+  int64_t syscallno;
+  uint64_t args[6];
+  int64_t result;
+};
+static_assert(sizeof(syscall_batch_entry) == 64,
+              "syscall_batch stub expects 64-byte entries");
+
+bool AutoRemoteSyscalls::can_batch_syscalls(
+    const vector<BatchedSyscall>& syscalls) {
+#if defined(__x86_64__) || defined(__aarch64__)
+  // During recording the seccomp filter would trap every syscall in the
+  // batch stub, since they aren't made from an untraced entry point. Use the
+  // slow path when running under rr for the same reason as in the
+  // constructor.
+  if (syscalls.size() < 2 || !t->session().is_replaying() ||
+      t->arch() != NativeArch::arch() || !t->vm()->has_rr_page() ||
+      running_under_rr() || enable_mem_params_ != ENABLE_MEMORY_PARAMS ||
+      t->is_dying() || t->vm()->has_watchpoints()) {
+    return false;
+  }
+  // Resuming from a syscall-entry or seccomp stop would let the tracee's
+  // pending syscall run. syscall_base knows how to handle those stops.
+  if (t->status().is_syscall() ||
+      t->ptrace_event() == PTRACE_EVENT_SECCOMP) {
+    return false;
+  }
+  // The stub is less than 64 bytes long.
+  for (int i = 0; i < 64; ++i) {
+    if (t->vm()->get_breakpoint_type_at_addr(
+            remote_code_ptr(RR_PAGE_SYSCALL_BATCH + i)) != BKPT_NONE) {
+      return false;
+    }
+  }
+  // The batch table goes just below sp, plus up to 15 bytes of padding.
+  size_t table_size =
+      (syscalls.size() + 1) * sizeof(syscall_batch_entry) + 16;
+  MemoryRange table_range(regs().sp() - table_size, regs().sp());
+  SupportedArch arch = t->arch();
+  for (const auto& s : syscalls) {
+    if ((is_munmap_syscall(s.syscallno, arch) ||
+         is_mprotect_syscall(s.syscallno, arch) ||
+         is_mremap_syscall(s.syscallno, arch) ||
+         is_madvise_syscall(s.syscallno, arch)) &&
+        table_range.intersects(MemoryRange(remote_ptr<void>(s.args[0]),
+                                           s.args[1]))) {
+      return false;
+    }
+    if (is_clone_syscall(s.syscallno, arch) ||
+        is_clone3_syscall(s.syscallno, arch) ||
+        is_fork_syscall(s.syscallno, arch) ||
+        is_vfork_syscall(s.syscallno, arch) ||
+        is_execve_syscall(s.syscallno, arch) ||
+        is_execveat_syscall(s.syscallno, arch)) {
+      return false;
+    }
+    if ((int)s.args[0] == SIGTRAP &&
+        (is_sigaction_syscall(s.syscallno, arch) ||
+         is_rt_sigaction_syscall(s.syscallno, arch) ||
+         is_signal_syscall(s.syscallno, arch))) {
+      return false;
+    }
+  }
+  return true;
+#else
+  (void)syscalls;
+  return false;
+#endif
+}
+
+size_t AutoRemoteSyscalls::syscall_batch(vector<BatchedSyscall>& syscalls) {
+  if (!can_batch_syscalls(syscalls)) {
+    size_t executed = 0;
+    for (auto& s : syscalls) {
+      Registers callregs = regs();
+      for (int i = 0; i < 6; ++i) {
+        callregs.set_arg(i + 1, s.args[i]);
+      }
+      s.result = syscall_base(s.syscallno, callregs);
+      if (s.result == -ESRCH && t->is_dying()) {
+        break;
+      }
+      ++executed;
+      long ret = word_size(arch()) == 4 ? (int)s.result : s.result;
+      if (-4096 < ret && ret < 0) {
+        break;
+      }
+    }
+    return executed;
+  }
+
+  LOG(debug) << "batching " << syscalls.size() << " syscalls";
+  vector<syscall_batch_entry> table(syscalls.size() + 1);
+  for (size_t i = 0; i < syscalls.size(); ++i) {
+    table[i].syscallno = syscalls[i].syscallno;
+    memcpy(table[i].args, syscalls[i].args, sizeof(table[i].args));
+    table[i].result = 0;
+  }
+  table.back().syscallno = -1;
+
+  // The stub addresses the table through sp, which must stay 16-byte aligned
+  // on aarch64.
+  size_t table_size = table.size() * sizeof(syscall_batch_entry);
+  size_t padding = (regs().sp().as_int() - table_size) & 15;
+  AutoRestoreMem mem(*this, nullptr, table_size + padding);
+  bool ok = true;
+  if (mem.get()) {
+    t->write_bytes_helper(mem.get(), table_size, table.data(), &ok);
+  }
+  if (!mem.get() || !ok) {
+    LOG(debug) << "Task is dying, don't try anything.";
+    return 0;
+  }
+
+  Registers callregs = regs();
+  callregs.set_ip(remote_code_ptr(RR_PAGE_SYSCALL_BATCH));
+  // Make sure the kernel doesn't try to restart an interrupted syscall
+  // when we resume.
+  callregs.set_original_syscallno(-1);
+  t->set_regs(callregs);
+  while (true) {
+    t->resume_execution(RESUME_CONT, RESUME_WAIT, RESUME_NO_TICKS);
+    LOG(debug) << "Used batch path; status=" << t->status();
+    if (t->ptrace_event() == PTRACE_EVENT_EXIT) {
+      restore_wait_status = t->status();
+      LOG(debug) << "Task is dying, no batch results";
+      return 0;
+    }
+    if (t->stop_sig() == SIGTRAP &&
+        AddressSpace::rr_page_start() <= t->ip().to_data_ptr<void>() &&
+        t->ip().to_data_ptr<void>() < AddressSpace::rr_page_end()) {
+      break;
+    }
+    if (ignore_signal(t)) {
+      // Interrupted syscalls are restarted by the kernel, since the signal
+      // is not delivered.
+      continue;
+    }
+    ASSERT(t, false) << "Unexpected status " << t->status();
+  }
+
+  size_t executed =
+      (t->regs().sp() - mem.get()) / sizeof(syscall_batch_entry);
+  ASSERT(t, executed <= syscalls.size())
+      << "Batch stub stopped at unexpected sp " << t->regs().sp();
+  t->read_bytes_helper(mem.get(), executed * sizeof(syscall_batch_entry),
+                       table.data());
+  for (size_t i = 0; i < executed; ++i) {
+    syscalls[i].result = table[i].result;
+  }
+  ASSERT(t, executed == syscalls.size() ||
+                (executed > 0 && (unsigned long)syscalls[executed - 1].result >
+                                     (unsigned long)-4096))
+      << "Batch stub stopped early at " << t->ip();
+  LOG(debug) << "done, executed " << executed << " syscalls";
+  return executed;
+}
+
 SupportedArch AutoRemoteSyscalls::arch() const { return t->arch(); }
 
 template <typename Arch>
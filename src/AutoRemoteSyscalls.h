@@ -249,6 +249,31 @@ public:
    */
   long syscall_base(int syscallno, Registers& callregs);
 
+  struct BatchedSyscall {
+    BatchedSyscall(int syscallno, uint64_t arg1 = 0, uint64_t arg2 = 0,
+                   uint64_t arg3 = 0, uint64_t arg4 = 0, uint64_t arg5 = 0,
+                   uint64_t arg6 = 0)
+        : syscallno(syscallno), args{ arg1, arg2, arg3, arg4, arg5, arg6 },
+          result(0) {}
+    int syscallno;
+    uint64_t args[6];
+    /* Raw kernel return value; only valid if the syscall was executed. */
+    long result;
+  };
+
+  /**
+   * Execute |syscalls| in order, stopping after the first one that fails,
+   * and return how many were executed. Returns early if the tracee dies.
+   *
+   * During replay of x86-64 and aarch64 tracees the whole batch runs with a
+   * single resume of the tracee, using a stub in the rr page that reads the
+   * syscalls from a table on the tracee stack. Otherwise the syscalls are made
+   * one at a time, as they also are if the batch contains clone, exec,
+   * SIGTRAP handler changes, or munmap/mprotect/mremap/madvise of the stack
+   * memory holding the table.
+   */
+  size_t syscall_batch(std::vector<BatchedSyscall>& syscalls);
+
   MemParamsEnabled enable_mem_params() { return enable_mem_params_; }
 
   /**
@@ -270,6 +295,7 @@ public:
 
 private:
   void setup_path(bool enable_singlestep_path);
+  bool can_batch_syscalls(const std::vector<BatchedSyscall>& syscalls);
 
   /**
    * "Recursively" build the set of syscall registers in
@@ -12,6 +12,8 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+
 #include "CompressedWriter.h"
 #include "core.h"
 #include "util.h"
@@ -31,6 +33,9 @@ CompressedReader::CompressedReader(const string& filename)
     eof = pread(*fd, &ch, 1, fd_offset) == 0;
   }
   buffer_read_pos = 0;
+  buffer_start = 0;
+  seek_skip = 0;
+  uncompressed_size = 0;
   have_saved_state = false;
 }
 
@@ -41,6 +46,10 @@ CompressedReader::CompressedReader(const CompressedReader& other) {
   eof = other.eof;
   buffer_read_pos = other.buffer_read_pos;
   buffer = other.buffer;
+  buffer_start = other.buffer_start;
+  seek_skip = other.seek_skip;
+  block_list = other.block_list;
+  uncompressed_size = other.uncompressed_size;
   have_saved_state = false;
   DEBUG_ASSERT(!other.have_saved_state);
 }
@@ -126,6 +135,7 @@ bool CompressedReader::read(void* data, size_t size) {
 }
 
 bool CompressedReader::refill_buffer() {
+  buffer_start += buffer.size();
   if (have_saved_state && !have_saved_buffer) {
     std::swap(buffer, saved_buffer);
     have_saved_buffer = true;
@@ -155,14 +165,82 @@ bool CompressedReader::refill_buffer() {
     error = true;
     return false;
   }
+  if (seek_skip) {
+    DEBUG_ASSERT(seek_skip < buffer.size());
+    buffer_read_pos = seek_skip;
+    seek_skip = 0;
+  }
 
   return true;
 }
 
+const vector<CompressedReader::Block>& CompressedReader::blocks() {
+  if (!block_list) {
+    block_list = make_shared<vector<Block>>();
+    uint64_t offset = 0;
+    uint64_t uncompressed_offset = 0;
+    CompressedWriter::BlockHeader header;
+    while (true) {
+      uint64_t header_offset = offset;
+      if (!read_all(*fd, sizeof(header), &header, &offset)) {
+        break;
+      }
+      block_list->push_back({ header_offset, uncompressed_offset });
+      uncompressed_offset += header.uncompressed_length;
+      offset += header.compressed_length;
+    }
+    uncompressed_size = uncompressed_offset;
+  }
+  return *block_list;
+}
+
+bool CompressedReader::seek(uint64_t offset) {
+  if (error) {
+    return false;
+  }
+  if (buffer_start <= offset && offset < buffer_start + buffer.size() &&
+      !seek_skip) {
+    buffer_read_pos = offset - buffer_start;
+    return true;
+  }
+
+  const vector<Block>& block_vector = blocks();
+  if (offset > uncompressed_size) {
+    return false;
+  }
+  if (have_saved_state && !have_saved_buffer) {
+    std::swap(buffer, saved_buffer);
+    have_saved_buffer = true;
+  }
+  buffer.clear();
+  buffer_read_pos = 0;
+  if (offset == uncompressed_size) {
+    fd_offset = lseek(*fd, 0, SEEK_END);
+    buffer_start = offset;
+    seek_skip = 0;
+    eof = true;
+    return true;
+  }
+  // Find the last block starting at or before |offset|.
+  auto it = upper_bound(block_vector.begin(), block_vector.end(), offset,
+                        [](uint64_t o, const Block& b) {
+                          return o < b.uncompressed_offset;
+                        });
+  DEBUG_ASSERT(it != block_vector.begin());
+  --it;
+  fd_offset = it->file_offset;
+  buffer_start = it->uncompressed_offset;
+  seek_skip = offset - it->uncompressed_offset;
+  eof = false;
+  return true;
+}
+
 void CompressedReader::rewind() {
   DEBUG_ASSERT(!have_saved_state);
   fd_offset = 0;
   buffer_read_pos = 0;
+  buffer_start = 0;
+  seek_skip = 0;
   buffer.clear();
   eof = false;
 }
@@ -175,20 +253,23 @@ void CompressedReader::save_state() {
   have_saved_buffer = false;
   saved_fd_offset = fd_offset;
   saved_buffer_read_pos = buffer_read_pos;
+  saved_buffer_start = buffer_start;
+  saved_seek_skip = seek_skip;
+  saved_eof = eof;
 }
 
 void CompressedReader::restore_state() {
   DEBUG_ASSERT(have_saved_state);
   have_saved_state = false;
-  if (saved_fd_offset < fd_offset) {
-    eof = false;
-  }
+  eof = saved_eof;
   fd_offset = saved_fd_offset;
   if (have_saved_buffer) {
     std::swap(buffer, saved_buffer);
     saved_buffer.clear();
   }
   buffer_read_pos = saved_buffer_read_pos;
+  buffer_start = saved_buffer_start;
+  seek_skip = saved_seek_skip;
 }
 
 void CompressedReader::discard_state() {
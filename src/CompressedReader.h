@@ -37,6 +37,19 @@ public:
   void rewind();
   void close();
 
+  /**
+   * Return the current read position as an offset into the uncompressed
+   * data stream.
+   */
+  uint64_t tell() const { return buffer_start + buffer_read_pos + seek_skip; }
+  /**
+   * Set the read position to |offset| in the uncompressed data stream.
+   * This only decompresses the block containing |offset|, and does so lazily
+   * on the next read, so it can also be used to skip large amounts of data
+   * cheaply. Returns false if |offset| is past the end of the stream.
+   */
+  bool seek(uint64_t offset);
+
   /**
    * Save the current position. Nested saves are not allowed.
    */
@@ -60,6 +73,18 @@ public:
 protected:
   bool refill_buffer();
 
+  struct Block {
+    // Offset of the block header in the file.
+    uint64_t file_offset;
+    // Offset of the block's first byte in the uncompressed stream.
+    uint64_t uncompressed_offset;
+  };
+  /**
+   * Return the list of blocks in the file, scanning the block headers if
+   * necessary. Copies of a reader share the list.
+   */
+  const std::vector<Block>& blocks();
+
   /* Our fd might be the dup of another fd, so we can't rely on its current file
      position.
      Instead track the current position in fd_offset and use pread. */
@@ -69,12 +94,22 @@ protected:
   bool eof;
   std::vector<uint8_t> buffer;
   size_t buffer_read_pos;
+  // Offset of buffer[0] in the uncompressed stream.
+  uint64_t buffer_start;
+  // After a seek(), the number of bytes to skip once the next block has
+  // been decompressed.
+  size_t seek_skip;
+  std::shared_ptr<std::vector<Block>> block_list;
+  uint64_t uncompressed_size;
 
   bool have_saved_state;
   bool have_saved_buffer;
   uint64_t saved_fd_offset;
   std::vector<uint8_t> saved_buffer;
   size_t saved_buffer_read_pos;
+  uint64_t saved_buffer_start;
+  size_t saved_seek_skip;
+  bool saved_eof;
 };
 
 } // namespace rr
@@ -52,6 +52,7 @@ CompressedWriter::CompressedWriter(const string& filename, size_t block_size,
   producer_reserved_pos = 0;
   producer_reserved_write_pos = 0;
   producer_reserved_upto_pos = 0;
+  producer_wait_seconds_ = 0;
   error = false;
   if (fd < 0) {
     error = true;
@@ -94,7 +95,31 @@ CompressedWriter::~CompressedWriter() {
   pthread_cond_destroy(&cond);
 }
 
+void CompressedWriter::get_buffer(uint8_t** data, size_t* size) {
+  if (!error && producer_reserved_upto_pos == producer_reserved_write_pos) {
+    update_reservation(WAIT);
+  }
+  if (error) {
+    *data = nullptr;
+    *size = 0;
+    return;
+  }
+  size_t buf_offset = (size_t)(producer_reserved_write_pos % buffer.size());
+  *data = &buffer[buf_offset];
+  *size = min(buffer.size() - buf_offset,
+              (size_t)(producer_reserved_upto_pos -
+                       producer_reserved_write_pos));
+}
+
 void CompressedWriter::write(const void* data, size_t size) {
+  if (!error && size > 0 &&
+      data == &buffer[producer_reserved_write_pos % buffer.size()]) {
+    // The data was produced in place via get_buffer().
+    DEBUG_ASSERT(size <=
+                 producer_reserved_upto_pos - producer_reserved_write_pos);
+    producer_reserved_write_pos += size;
+    size = 0;
+  }
   while (!error && size > 0) {
     uint64_t reservation_size =
         producer_reserved_upto_pos - producer_reserved_write_pos;
@@ -143,7 +168,9 @@ void CompressedWriter::update_reservation(WaitFlag wait_flag) {
       break;
     }
 
+    double wait_start = monotonic_now_sec();
     pthread_cond_wait(&cond, &mutex);
+    producer_wait_seconds_ += monotonic_now_sec() - wait_start;
   }
 
   pthread_mutex_unlock(&mutex);
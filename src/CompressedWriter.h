@@ -38,6 +38,14 @@ public:
   bool good() const { return !error; }
   // Call only on producer thread.
   void write(const void* data, size_t size);
+  // Returns pointer/size of free space in the buffer where the next write()
+  // will put its data. The caller may fill some prefix of it directly and
+  // then call write() with the returned pointer, which skips the copy.
+  // Returns zero size after an error. Call only on producer thread.
+  void get_buffer(uint8_t** data, size_t* size);
+  // Total time the producer thread has spent blocked waiting for
+  // compression threads to free buffer space. Call only on producer thread.
+  double producer_wait_seconds() const { return producer_wait_seconds_; }
   enum Sync { DONT_SYNC, SYNC };
   // Call only on producer thread
   void close(Sync sync = DONT_SYNC);
@@ -83,6 +91,7 @@ protected:
   uint64_t producer_reserved_pos;
   uint64_t producer_reserved_write_pos;
   uint64_t producer_reserved_upto_pos;
+  double producer_wait_seconds_;
   bool error;
 };
 
@@ -14,6 +14,7 @@
 
 #include "AddressSpace.h"
 #include "Command.h"
+#include "TraceFrameIndex.h"
 #include "TraceStream.h"
 #include "core.h"
 #include "kernel_metadata.h"
@@ -49,7 +50,15 @@ DumpCommand DumpCommand::singleton(
     "                             machine-parseable format instead of the\n"
     "                             default human-readable format\n"
     "  -s, --statistics           dump statistics about the trace\n"
-    "  -t, --tid=<pid>            dump events only for the specified tid\n");
+    "  -t, --tid=<pid>            dump events only for the specified tid\n"
+    "  -y, --syscall=<NAME>       dump only (unbuffered) syscall events for\n"
+    "                             syscall <NAME>\n"
+    "  -w, --wrote=<ADDR>         dump only events that recorded a memory\n"
+    "                             write covering address <ADDR>\n"
+    "  -j, --json                 dump one JSON object per event. Syscallbuf\n"
+    "                             contents and socket addresses are omitted.\n"
+    "  If the trace has been indexed with `rr index', only the requested\n"
+    "  events are decoded, and large ranges are decoded in parallel.\n");
 
 static bool parse_dump_arg(vector<string>& args, DumpFlags& flags) {
   if (parse_global_option(args)) {
@@ -65,6 +74,9 @@ static bool parse_dump_arg(vector<string>& args, DumpFlags& flags) {
     { 'r', "raw", NO_PARAMETER },
     { 's', "statistics", NO_PARAMETER },
     { 't', "tid", HAS_PARAMETER },
+    { 'y', "syscall", HAS_PARAMETER },
+    { 'w', "wrote", HAS_PARAMETER },
+    { 'j', "json", NO_PARAMETER },
   };
   ParsedOption opt;
   if (!Command::parse_option(args, options, &opt)) {
@@ -96,6 +108,21 @@ static bool parse_dump_arg(vector<string>& args, DumpFlags& flags) {
       }
       flags.only_tid = opt.int_value;
       break;
+    case 'y':
+      flags.only_syscall = opt.value;
+      break;
+    case 'w': {
+      char* end;
+      flags.only_written_addr = strtoull(opt.value.c_str(), &end, 0);
+      if (*end || !flags.only_written_addr) {
+        fprintf(stderr, "Invalid address %s\n", opt.value.c_str());
+        return false;
+      }
+      break;
+    }
+    case 'j':
+      flags.json_dump = true;
+      break;
     case 0:
       flags.dump_socket_addrs = true;
       break;
@@ -234,61 +261,95 @@ static void dump_task_event(FILE* out, const TraceTaskEvent& event) {
   }
 }
 
-/**
- * Dump all events from the current to trace that match |spec| to
- * |out|.  |spec| has the following syntax: /\d+(-\d+)?/, expressing
- * either a single event number of a range, and may be null to
- * indicate "dump all events".
- *
- * This function is side-effect-y, in that the trace file isn't
- * rewound in between matching each spec.  Therefore specs should be
- * constructed so as to match properly on a serial linear scan; that
- * is, they should comprise disjoint and monotonically increasing
- * event sets.  No attempt is made to enforce this or normalize specs.
- */
-static void dump_events_matching(TraceReader& trace, const DumpFlags& flags,
-                                 FILE* out, const string* spec,
-                                 const unordered_map<FrameTime, TraceTaskEvent>& task_events) {
-
-  uint32_t start = 0, end = numeric_limits<uint32_t>::max();
-  bool only_end = false;
-
-  if (spec && *spec == "end") {
-    only_end = true;
-  } else {
-    // Try to parse the "range" syntax '[start]-[end]'.
-    if (spec && 2 > sscanf(spec->c_str(), "%u-%u", &start, &end)) {
-      // Fall back on assuming the spec is a single event
-      // number, however it parses out with atoi().
-      start = end = atoi(spec->c_str());
+static bool frame_matches(TraceReader& trace, const TraceFrame& frame,
+                          const DumpFlags& flags) {
+  if (flags.only_tid && flags.only_tid != frame.tid()) {
+    return false;
+  }
+  if (!flags.only_syscall.empty()) {
+    const Event& ev = frame.event();
+    if (!ev.is_syscall_event() ||
+        syscall_name(ev.Syscall().number, ev.Syscall().arch()) !=
+            flags.only_syscall) {
+      return false;
     }
   }
+  if (flags.only_written_addr) {
+    bool found = false;
+    for (auto& rec : trace.raw_data_metadata_for_frame()) {
+      if (rec.addr.as_int() <= flags.only_written_addr &&
+          flags.only_written_addr < rec.addr.as_int() + rec.size) {
+        found = true;
+        break;
+      }
+    }
+    if (!found) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void dump_frame_json(FILE* out, const TraceFrame& frame) {
+  const Event& ev = frame.event();
+  fprintf(out,
+          "{\"time\":%lld,\"tid\":%d,\"ticks\":%" PRId64
+          ",\"realTime\":%f,\"event\":\"%s\"",
+          (long long)frame.time(), frame.tid(), frame.ticks(),
+          frame.monotonic_time(), json_escape(ev.type_name()).c_str());
+  if (ev.is_syscall_event()) {
+    fprintf(out, ",\"syscall\":\"%s\",\"state\":\"%s\"",
+            json_escape(syscall_name(ev.Syscall().number,
+                                     ev.Syscall().arch())).c_str(),
+            state_name(ev.Syscall().state));
+  }
+}
 
+/**
+ * Dump the events from the current position of |trace| whose times are in
+ * [start, end] (or just the last event, if |only_end|) and match |flags|.
+ * Stops after reading the first frame past |end|.
+ */
+static void dump_frames(TraceReader& trace, const DumpFlags& flags,
+                        FILE* out, FrameTime start, FrameTime end,
+                        bool only_end,
+                        const unordered_map<FrameTime, TraceTaskEvent>& task_events) {
   bool process_raw_data =
       flags.dump_syscallbuf || flags.dump_recorded_data_metadata;
-  while (!trace.at_end()) {
+  // Stop before reading the first frame past |end|, so that the next spec
+  // starts from it and its raw data stays unread.
+  while (!trace.at_end() && trace.time() < end) {
     auto frame = trace.read_frame();
-    if (end < frame.time()) {
-      return;
-    }
     if (only_end ? trace.at_end() :
          (start <= frame.time() && frame.time() <= end &&
-           (!flags.only_tid || flags.only_tid == frame.tid()))) {
-      if (flags.raw_dump) {
+           frame_matches(trace, frame, flags))) {
+      if (flags.json_dump) {
+        dump_frame_json(out, frame);
+      } else if (flags.raw_dump) {
         frame.dump_raw(out);
       } else {
         frame.dump(out);
       }
-      if (flags.dump_syscallbuf) {
+      if (flags.dump_syscallbuf && !flags.json_dump) {
         dump_syscallbuf_data(trace, out, frame, flags);
       }
       if (flags.dump_task_events) {
         auto it = task_events.find(frame.time());
         if (it != task_events.end()) {
-          dump_task_event(out, it->second);
+          if (flags.json_dump) {
+            fprintf(out, ",\"taskEvent\":{\"type\":\"%s\",\"tid\":%d}",
+                    it->second.type() == TraceTaskEvent::CLONE ? "clone" :
+                    it->second.type() == TraceTaskEvent::EXEC ? "exec" :
+                    it->second.type() == TraceTaskEvent::EXIT ? "exit" :
+                                                                "detach",
+                    it->second.tid());
+          } else {
+            dump_task_event(out, it->second);
+          }
         }
       }
 
+      bool first_mmap = true;
       while (true) {
         TraceReader::MappedData data;
         bool found;
@@ -316,6 +377,16 @@ static void dump_events_matching(TraceReader& trace, const DumpFlags& flags,
             static const char source_zero[] = "<ZERO>";
             fsname = source_zero;
           }
+          if (flags.json_dump) {
+            fprintf(out, "%s{\"mapFile\":\"%s\",\"addr\":%llu,"
+                         "\"length\":%llu,\"protFlags\":\"%s\"}",
+                    first_mmap ? ",\"mmaps\":[" : ",",
+                    json_escape(fsname).c_str(),
+                    (unsigned long long)km.start().as_int(),
+                    (unsigned long long)km.size(), prot_flags);
+            first_mmap = false;
+            continue;
+          }
           fprintf(out, "  { map_file:\"%s\", addr:%p, length:%p, "
                        "prot_flags:\"%s\", file_offset:0x%llx, "
                        "device:%lld, inode:%lld, "
@@ -328,10 +399,22 @@ static void dump_events_matching(TraceReader& trace, const DumpFlags& flags,
                   (long long)data.file_size_bytes);
         }
       }
+      if (!first_mmap) {
+        fputc(']', out);
+      }
 
+      bool first_write = true;
       TraceReader::RawDataMetadata data;
       while (process_raw_data && trace.read_raw_data_metadata_for_frame(data)) {
         if (flags.dump_recorded_data_metadata) {
+          if (flags.json_dump) {
+            fprintf(out, "%s{\"tid\":%d,\"addr\":%llu,\"length\":%llu}",
+                    first_write ? ",\"memWrites\":[" : ",", data.rec_tid,
+                    (unsigned long long)data.addr.as_int(),
+                    (unsigned long long)data.size);
+            first_write = false;
+            continue;
+          }
           fprintf(out, "  { tid:%d, addr:%p, length:%p", data.rec_tid,
                   (void*)data.addr.as_int(), (void*)data.size);
           if (!data.holes.empty()) {
@@ -348,10 +431,15 @@ static void dump_events_matching(TraceReader& trace, const DumpFlags& flags,
           fputs(" }\n", out);
         }
       }
-      if (flags.dump_socket_addrs) {
+      if (!first_write) {
+        fputc(']', out);
+      }
+      if (flags.dump_socket_addrs && !flags.json_dump) {
         dump_socket_addrs(out, frame);
       }
-      if (!flags.raw_dump) {
+      if (flags.json_dump) {
+        fputs("}\n", out);
+      } else if (!flags.raw_dump) {
         fprintf(out, "}\n");
       }
     } else {
@@ -370,6 +458,139 @@ static void dump_events_matching(TraceReader& trace, const DumpFlags& flags,
   }
 }
 
+/**
+ * Frames per unit of work when dumping in parallel. Each worker buffers the
+ * output for its chunk, so this also bounds memory usage.
+ */
+static const FrameTime PARALLEL_DUMP_CHUNK_FRAMES = 16384;
+
+struct DumpChunk {
+  TraceReader* trace;
+  const DumpFlags* flags;
+  FrameTime start;
+  FrameTime end;
+  const unordered_map<FrameTime, TraceTaskEvent>* task_events;
+  char* output;
+  size_t output_size;
+};
+
+static void* dump_chunk_thread(void* p) {
+  DumpChunk* chunk = static_cast<DumpChunk*>(p);
+  FILE* out = open_memstream(&chunk->output, &chunk->output_size);
+  dump_frames(*chunk->trace, *chunk->flags, out, chunk->start, chunk->end,
+              false, *chunk->task_events);
+  fclose(out);
+  return nullptr;
+}
+
+/**
+ * Dump frames [start, end] using multiple threads, each decoding its own
+ * chunk of the range from an independent copy of |trace| positioned via the
+ * frame index. |last| is the last frame in the index. Output is written in
+ * order. The final chunk is dumped from |trace| itself so that it ends up
+ * where a sequential dump would leave it.
+ */
+static void dump_frames_parallel(TraceReader& trace, const DumpFlags& flags,
+                                 FILE* out, FrameTime start, FrameTime last,
+                                 FrameTime end, int num_threads,
+                                 const unordered_map<FrameTime, TraceTaskEvent>& task_events) {
+  FrameTime chunk_start = start;
+  while (last - chunk_start >= PARALLEL_DUMP_CHUNK_FRAMES) {
+    vector<unique_ptr<TraceReader>> readers;
+    vector<DumpChunk> chunks;
+    for (int i = 0; i < num_threads &&
+                    last - chunk_start >= PARALLEL_DUMP_CHUNK_FRAMES; ++i) {
+      readers.push_back(unique_ptr<TraceReader>(new TraceReader(trace)));
+      if (!readers.back()->seek_to_frame(chunk_start)) {
+        FATAL() << "Can't seek to frame " << chunk_start;
+      }
+      chunks.push_back({ readers.back().get(), &flags, chunk_start,
+                         chunk_start + PARALLEL_DUMP_CHUNK_FRAMES - 1,
+                         &task_events, nullptr, 0 });
+      chunk_start += PARALLEL_DUMP_CHUNK_FRAMES;
+    }
+
+    vector<pthread_t> threads;
+    for (auto& chunk : chunks) {
+      pthread_t thread;
+      pthread_create(&thread, nullptr, dump_chunk_thread, &chunk);
+      threads.push_back(thread);
+    }
+    for (size_t i = 0; i < threads.size(); ++i) {
+      pthread_join(threads[i], nullptr);
+      fwrite(chunks[i].output, 1, chunks[i].output_size, out);
+      free(chunks[i].output);
+    }
+  }
+
+  if (!trace.seek_to_frame(chunk_start)) {
+    FATAL() << "Can't seek to frame " << chunk_start;
+  }
+  dump_frames(trace, flags, out, chunk_start, end, false, task_events);
+}
+
+/**
+ * Dump all events from the current to trace that match |spec| to
+ * |out|.  |spec| has the following syntax: /\d+(-\d+)?/, expressing
+ * either a single event number of a range, and may be null to
+ * indicate "dump all events".
+ *
+ * This function is side-effect-y, in that the trace file isn't
+ * rewound in between matching each spec.  Therefore specs should be
+ * constructed so as to match properly on a serial linear scan; that
+ * is, they should comprise disjoint and monotonically increasing
+ * event sets.  No attempt is made to enforce this or normalize specs.
+ * If the trace has a frame index, we instead jump straight to the first
+ * event of each spec, and large ranges are decoded in parallel.
+ */
+static void dump_events_matching(TraceReader& trace, const DumpFlags& flags,
+                                 FILE* out, const string* spec,
+                                 const unordered_map<FrameTime, TraceTaskEvent>& task_events) {
+
+  uint32_t start = 0, end = numeric_limits<uint32_t>::max();
+  bool only_end = false;
+
+  if (spec && *spec == "end") {
+    only_end = true;
+  } else {
+    // Try to parse the "range" syntax '[start]-[end]'.
+    if (spec && 2 > sscanf(spec->c_str(), "%u-%u", &start, &end)) {
+      // Fall back on assuming the spec is a single event
+      // number, however it parses out with atoi().
+      start = end = atoi(spec->c_str());
+    }
+  }
+
+  const TraceFrameIndex* index = trace.frame_index();
+  if (!index) {
+    dump_frames(trace, flags, out, start, end, only_end, task_events);
+    return;
+  }
+
+  FrameTime last = index->size();
+  if (only_end) {
+    if (last > trace.time()) {
+      trace.seek_to_frame(last);
+    }
+    dump_frames(trace, flags, out, start, end, true, task_events);
+    return;
+  }
+
+  FrameTime first = max<FrameTime>(start, 1);
+  if (first != trace.time() + 1 && !trace.seek_to_frame(first)) {
+    // |first| is past the end of the trace.
+    return;
+  }
+  last = min<FrameTime>(last, end);
+  int num_threads = min(8, get_num_cpus());
+  if (num_threads > 1 && last - first >= 2 * PARALLEL_DUMP_CHUNK_FRAMES) {
+    dump_frames_parallel(trace, flags, out, first, last, end, num_threads,
+                         task_events);
+  } else {
+    dump_frames(trace, flags, out, first, end, false, task_events);
+  }
+}
+
 static void dump_statistics(const TraceReader& trace, FILE* out) {
   uint64_t uncompressed = trace.uncompressed_bytes();
   uint64_t compressed = trace.compressed_bytes();
@@ -382,7 +603,7 @@ void dump(const string& trace_dir, const DumpFlags& flags,
           const vector<string>& specs, FILE* out) {
   TraceReader trace(trace_dir);
 
-  if (flags.raw_dump) {
+  if (flags.raw_dump && !flags.json_dump) {
     fprintf(out, "global_time tid reason ticks "
                  "hw_interrupts page_faults instructions "
                  "eax ebx ecx edx esi edi ebp orig_eax esp eip eflags\n");
@@ -412,7 +633,7 @@ void dump(const string& trace_dir, const DumpFlags& flags,
     dump_events_matching(trace, flags, out, nullptr /*all events*/, task_events);
   }
 
-  if (flags.dump_statistics) {
+  if (flags.dump_statistics && !flags.json_dump) {
     dump_statistics(trace, out);
   }
 }
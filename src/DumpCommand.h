@@ -7,6 +7,7 @@
 #define _DEFAULT_SOURCE 1
 #endif
 
+#include <stdint.h>
 #include <stdio.h>
 
 #include <memory>
@@ -23,7 +24,12 @@ struct DumpFlags {
   bool raw_dump;
   bool dump_statistics;
   bool dump_socket_addrs;
+  bool json_dump;
   int only_tid;
+  // When non-empty, only dump syscall events for this syscall.
+  std::string only_syscall;
+  // When nonzero, only dump events that wrote memory at this address.
+  uintptr_t only_written_addr;
 
   DumpFlags()
       : dump_syscallbuf(false),
@@ -33,7 +39,9 @@ struct DumpFlags {
         raw_dump(false),
         dump_statistics(false),
         dump_socket_addrs(false),
-        only_tid(0) {}
+        json_dump(false),
+        only_tid(0),
+        only_written_addr(0) {}
 };
 
 void dump(const std::string& trace_dir, const DumpFlags& flags,
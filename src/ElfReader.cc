@@ -4,10 +4,13 @@
 
 #include <elf.h>
 #include <endian.h>
+#include <pthread.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <zlib.h>
 
+#include <map>
+
 #include "log.h"
 #include "util.h"
 
@@ -15,6 +18,78 @@ using namespace std;
 
 namespace rr {
 
+typedef shared_ptr<const vector<uint8_t>> DecompressedSectionPtr;
+
+/**
+ * Process-wide cache of decompressed sections, keyed by build-id and section
+ * file offset. The same separate-debuginfo and dwz files are typically
+ * shared by many binaries, so e.g. `rr sources` would otherwise inflate
+ * their sections over and over. Least-recently-used entries are dropped once
+ * the cache exceeds its budget; readers still using them keep them alive.
+ * Safe to use from multiple threads.
+ */
+class DecompressedSectionCache {
+public:
+  static DecompressedSectionCache& get() {
+    static DecompressedSectionCache cache;
+    return cache;
+  }
+
+  DecompressedSectionPtr find(const string& key) {
+    pthread_mutex_lock(&lock);
+    DecompressedSectionPtr result;
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+      it->second.last_use = ++use_counter;
+      result = it->second.data;
+    }
+    pthread_mutex_unlock(&lock);
+    return result;
+  }
+
+  void insert(const string& key, DecompressedSectionPtr data) {
+    if (data->size() > BUDGET_BYTES / 4) {
+      // Don't let one huge section flush everything else.
+      return;
+    }
+    pthread_mutex_lock(&lock);
+    auto& entry = entries[key];
+    if (entry.data) {
+      bytes -= entry.data->size();
+    }
+    bytes += data->size();
+    entry.data = std::move(data);
+    entry.last_use = ++use_counter;
+    while (bytes > BUDGET_BYTES) {
+      auto victim = entries.begin();
+      for (auto e = entries.begin(); e != entries.end(); ++e) {
+        if (e->second.last_use < victim->second.last_use) {
+          victim = e;
+        }
+      }
+      bytes -= victim->second.data->size();
+      entries.erase(victim);
+    }
+    pthread_mutex_unlock(&lock);
+  }
+
+private:
+  static const size_t BUDGET_BYTES = 512 * 1024 * 1024;
+
+  DecompressedSectionCache() : bytes(0), use_counter(0) {
+    pthread_mutex_init(&lock, nullptr);
+  }
+
+  struct Entry {
+    DecompressedSectionPtr data;
+    uint64_t last_use;
+  };
+  pthread_mutex_t lock;
+  map<string, Entry> entries;
+  size_t bytes;
+  uint64_t use_counter;
+};
+
 class ElfReaderImplBase {
 public:
   ElfReaderImplBase(ElfReader& r) : r(r), ok_(false) {}
@@ -32,7 +107,8 @@ public:
 
 protected:
   ElfReader& r;
-  vector<unique_ptr<vector<uint8_t>>> decompressed_sections;
+  // Keyed by section file offset.
+  map<uint64_t, DecompressedSectionPtr> decompressed_sections;
   bool ok_;
 };
 
@@ -177,6 +253,21 @@ SectionOffsets ElfReaderImpl<Arch>::find_section_file_offsets(
 template <typename Arch>
 const vector<uint8_t>* ElfReaderImpl<Arch>::decompress_section(SectionOffsets offsets) {
   DEBUG_ASSERT(offsets.compressed);
+  auto existing = decompressed_sections.find(offsets.start);
+  if (existing != decompressed_sections.end()) {
+    return existing->second.get();
+  }
+  uint64_t section_start = offsets.start;
+  string cache_key = read_buildid();
+  if (!cache_key.empty()) {
+    cache_key += ":" + to_string(offsets.start) + ":" + to_string(offsets.end);
+    auto cached = DecompressedSectionCache::get().find(cache_key);
+    if (cached) {
+      decompressed_sections[section_start] = cached;
+      return cached.get();
+    }
+  }
+
   auto hdr = r.read<typename Arch::ElfChdr>(offsets.start);
   if (!hdr) {
     LOG(warn) << "section at " << offsets.start
@@ -202,7 +293,7 @@ const vector<uint8_t>* ElfReaderImpl<Arch>::decompress_section(SectionOffsets of
     }
   }
 
-  unique_ptr<vector<uint8_t>> v(new vector<uint8_t>());
+  auto v = make_shared<vector<uint8_t>>();
   v->resize(decompressed_size);
 
   z_stream stream;
@@ -229,8 +320,11 @@ const vector<uint8_t>* ElfReaderImpl<Arch>::decompress_section(SectionOffsets of
     return nullptr;
   }
 
-  decompressed_sections.push_back(std::move(v));
-  return decompressed_sections.back().get();
+  if (!cache_key.empty()) {
+    DecompressedSectionCache::get().insert(cache_key, v);
+  }
+  decompressed_sections[section_start] = v;
+  return v.get();
 }
 
 template <typename Arch>
@@ -541,7 +635,11 @@ DwarfSpan ElfReader::dwarf_section(const char* name, bool known_to_be_compressed
   offsets.compressed |= known_to_be_compressed;
   if (offsets.start && offsets.compressed) {
     auto decompressed = impl().decompress_section(offsets);
-    return DwarfSpan(&decompressed->front(), &decompressed->back());
+    if (!decompressed) {
+      return DwarfSpan();
+    }
+    return DwarfSpan(decompressed->data(),
+                     decompressed->data() + decompressed->size());
   }
   return DwarfSpan(map + offsets.start, map + offsets.end);
 }
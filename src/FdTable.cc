@@ -4,6 +4,7 @@
 
 #include <limits.h>
 
+#include <map>
 #include <unordered_set>
 #include <utility>
 
@@ -48,7 +49,7 @@ void FdTable::add_monitor(Task* t, int fd, FileMonitor* monitor) {
     ASSERT(t, false) << "Task " << t->rec_tid << " already monitoring fd "
       << fd << " " << file_monitor_type_name(current->type());
   }
-  if (fd >= SYSCALLBUF_FDS_DISABLED_SIZE && fds.count(fd) == 0) {
+  if (fd >= SYSCALLBUF_FDS_HI_LIMIT && fds.count(fd) == 0) {
     fd_count_beyond_limit++;
   }
   fds[fd] = FileMonitor::shr_ptr(monitor);
@@ -124,12 +125,12 @@ void FdTable::did_write(Task* t, int fd,
 
 void FdTable::did_dup(int from, int to) {
   if (fds.count(from)) {
-    if (to >= SYSCALLBUF_FDS_DISABLED_SIZE && fds.count(to) == 0) {
+    if (to >= SYSCALLBUF_FDS_HI_LIMIT && fds.count(to) == 0) {
       fd_count_beyond_limit++;
     }
     fds[to] = fds[from];
   } else {
-    if (to >= SYSCALLBUF_FDS_DISABLED_SIZE && fds.count(to) > 0) {
+    if (to >= SYSCALLBUF_FDS_HI_LIMIT && fds.count(to) > 0) {
       fd_count_beyond_limit--;
     }
     fds.erase(to);
@@ -139,7 +140,7 @@ void FdTable::did_dup(int from, int to) {
 
 void FdTable::did_close(int fd) {
   LOG(debug) << "Close fd " << fd;
-  if (fd >= SYSCALLBUF_FDS_DISABLED_SIZE && fds.count(fd) > 0) {
+  if (fd >= SYSCALLBUF_FDS_HI_LIMIT && fds.count(fd) > 0) {
     fd_count_beyond_limit--;
   }
   fds.erase(fd);
@@ -163,7 +164,7 @@ static syscallbuf_fd_classes join_fd_classes_over_tasks(AddressSpace* vm, int fd
         return FD_CLASS_TRACED;
       }
       cls = table->get_monitor(fd)->get_syscallbuf_class();
-    } else if (fd >= SYSCALLBUF_FDS_DISABLED_SIZE - 1 &&
+    } else if (fd >= SYSCALLBUF_FDS_HI_LIMIT &&
         table->count_beyond_limit() > 0) {
       return FD_CLASS_TRACED;
     }
@@ -171,6 +172,65 @@ static syscallbuf_fd_classes join_fd_classes_over_tasks(AddressSpace* vm, int fd
   return cls;
 }
 
+static remote_ptr<uint64_t> fds_traced_word(RecordTask* rt, int word) {
+  return REMOTE_PTR_FIELD(rt->preload_globals, syscallbuf_fds_traced[0])
+             .cast<uint64_t>() + word;
+}
+
+static remote_ptr<uint64_t> fds_traced_summary_word(RecordTask* rt,
+                                                     int summary_word) {
+  return REMOTE_PTR_FIELD(rt->preload_globals,
+                          syscallbuf_fds_traced_summary[0])
+             .cast<uint64_t>() + summary_word;
+}
+
+static remote_ptr<uint64_t> fds_proc_mem_word(RecordTask* rt, int word) {
+  return REMOTE_PTR_FIELD(rt->preload_globals, syscallbuf_fds_proc_mem[0])
+             .cast<uint64_t>() + word;
+}
+
+static void write_fds_traced_word(RecordTask* rt, remote_ptr<uint64_t> addr,
+                                  uint64_t value) {
+  rt->write_mem(addr, value);
+  rt->record_local(addr, &value);
+}
+
+/**
+ * Set or clear |bit| in the tracee's bitmap word at |addr|. The word is only
+ * written (and recorded) if it changes. Returns the word's old value.
+ */
+static uint64_t update_fds_bitmap_word(RecordTask* rt,
+                                       remote_ptr<uint64_t> addr,
+                                       uint64_t bit, bool set) {
+  uint64_t old_bits = rt->read_mem(addr);
+  uint64_t new_bits = set ? (old_bits | bit) : (old_bits & ~bit);
+  if (new_bits != old_bits) {
+    write_fds_traced_word(rt, addr, new_bits);
+  }
+  return old_bits;
+}
+
+/**
+ * Store |cls| for |fd| in the tracee's syscallbuf_fds_traced and
+ * syscallbuf_fds_proc_mem bitmaps, keeping the summary bitmap consistent.
+ */
+static void update_high_fd_class(RecordTask* rt, int fd,
+                                 syscallbuf_fd_classes cls) {
+  int word = fd / 64;
+  uint64_t bit = uint64_t(1) << (fd % 64);
+  update_fds_bitmap_word(rt, fds_proc_mem_word(rt, word), bit,
+                         cls == FD_CLASS_PROC_MEM);
+  bool traced = cls != FD_CLASS_UNTRACED;
+  uint64_t old_bits =
+      update_fds_bitmap_word(rt, fds_traced_word(rt, word), bit, traced);
+  uint64_t new_bits = traced ? (old_bits | bit) : (old_bits & ~bit);
+  if (!old_bits == !new_bits) {
+    return;
+  }
+  update_fds_bitmap_word(rt, fds_traced_summary_word(rt, word / 64),
+                         uint64_t(1) << (word % 64), new_bits != 0);
+}
+
 void FdTable::update_syscallbuf_fds_disabled(int fd) {
   DEBUG_ASSERT(fd >= 0);
   DEBUG_ASSERT(task_set().size() > 0);
@@ -190,12 +250,16 @@ void FdTable::update_syscallbuf_fds_disabled(int fd) {
       rt = nullptr;
     }
     if (rt && !rt->preload_globals.is_null()) {
-      if (fd >= SYSCALLBUF_FDS_DISABLED_SIZE) {
-        fd = SYSCALLBUF_FDS_DISABLED_SIZE - 1;
+      if (fd >= SYSCALLBUF_FDS_DISABLED_SIZE - 1 &&
+          fd < SYSCALLBUF_FDS_HI_LIMIT) {
+        update_high_fd_class(rt, fd,
+            join_fd_classes_over_tasks(address_space.first, fd));
+        continue;
       }
+      int slot = min(fd, SYSCALLBUF_FDS_DISABLED_SIZE - 1);
       char disable = (char)join_fd_classes_over_tasks(address_space.first, fd);
       auto addr =
-          REMOTE_PTR_FIELD(rt->preload_globals, syscallbuf_fd_class[0]) + fd;
+          REMOTE_PTR_FIELD(rt->preload_globals, syscallbuf_fd_class[0]) + slot;
       rt->write_mem(addr, disable);
       rt->record_local(addr, &disable);
     }
@@ -216,6 +280,8 @@ void FdTable::init_syscallbuf_fds_disabled(Task* t) {
 
   char disabled[SYSCALLBUF_FDS_DISABLED_SIZE];
   memset(disabled, 0, sizeof(disabled));
+  // Classes of monitored fds covered by the syscallbuf_fds_traced bitmap.
+  map<int, syscallbuf_fd_classes> high_fds;
 
   // It's possible that some tasks in this address space have a different
   // FdTable. We need to disable syscallbuf for an fd if any tasks for this
@@ -224,6 +290,16 @@ void FdTable::init_syscallbuf_fds_disabled(Task* t) {
     for (auto& it : vm_t->fd_table()->fds) {
       int fd = it.first;
       DEBUG_ASSERT(fd >= 0);
+      if (fd >= SYSCALLBUF_FDS_DISABLED_SIZE - 1 &&
+          fd < SYSCALLBUF_FDS_HI_LIMIT) {
+        auto high = high_fds.find(fd);
+        if (high == high_fds.end() || high->second == FD_CLASS_UNTRACED) {
+          high_fds[fd] = it.second->get_syscallbuf_class();
+        } else {
+          high->second = FD_CLASS_TRACED;
+        }
+        continue;
+      }
       if (fd >= SYSCALLBUF_FDS_DISABLED_SIZE) {
         fd = SYSCALLBUF_FDS_DISABLED_SIZE - 1;
       }
@@ -238,6 +314,31 @@ void FdTable::init_syscallbuf_fds_disabled(Task* t) {
   auto addr = REMOTE_PTR_FIELD(t->preload_globals, syscallbuf_fd_class[0]);
   rt->write_mem(addr, disabled, SYSCALLBUF_FDS_DISABLED_SIZE);
   rt->record_local(addr, disabled, SYSCALLBUF_FDS_DISABLED_SIZE);
+
+  // The bitmaps start out zeroed, so we only need to write nonzero words.
+  map<int, uint64_t> traced_words;
+  map<int, uint64_t> proc_mem_words;
+  for (auto& it : high_fds) {
+    uint64_t bit = uint64_t(1) << (it.first % 64);
+    if (it.second != FD_CLASS_UNTRACED) {
+      traced_words[it.first / 64] |= bit;
+    }
+    if (it.second == FD_CLASS_PROC_MEM) {
+      proc_mem_words[it.first / 64] |= bit;
+    }
+  }
+  for (auto& it : proc_mem_words) {
+    write_fds_traced_word(rt, fds_proc_mem_word(rt, it.first), it.second);
+  }
+  map<int, uint64_t> summary_words;
+  for (auto& it : traced_words) {
+    write_fds_traced_word(rt, fds_traced_word(rt, it.first), it.second);
+    summary_words[it.first / 64] |= uint64_t(1) << (it.first % 64);
+  }
+  for (auto& it : summary_words) {
+    write_fds_traced_word(rt, fds_traced_summary_word(rt, it.first),
+                          it.second);
+  }
 }
 
 void FdTable::close_after_exec(ReplayTask* t, const vector<int>& fds_to_close) {
@@ -89,7 +89,7 @@ private:
 
   std::unordered_map<int, FileMonitor::shr_ptr> fds;
   std::unordered_map<AddressSpace*, int> vms;
-  // Number of elements of `fds` that are >= SYSCALLBUF_FDS_DISABLED_SIZE
+  // Number of elements of `fds` that are >= SYSCALLBUF_FDS_HI_LIMIT
   uint32_t fd_count_beyond_limit;
   int last_free_fd_;
 };
@@ -0,0 +1,45 @@
+/* -*- Mode: C++; tab-width: 8; c-basic-offset: 2; indent-tabs-mode: nil; -*- */
+
+#include "Command.h"
+#include "TraceFrameIndex.h"
+#include "TraceStream.h"
+#include "main.h"
+
+using namespace std;
+
+namespace rr {
+
+class IndexCommand : public Command {
+public:
+  virtual int run(vector<string>& args) override;
+
+protected:
+  IndexCommand(const char* name, const char* help) : Command(name, help) {}
+
+  static IndexCommand singleton;
+};
+
+IndexCommand IndexCommand::singleton(
+    "index",
+    " rr index [<trace_dir>]\n"
+    "  Write an index of the trace's events so that `rr dump` and other\n"
+    "  tools can jump directly to a given event.\n");
+
+int IndexCommand::run(vector<string>& args) {
+  while (parse_global_option(args)) {
+  }
+
+  string trace_dir;
+  if (!parse_optional_trace_dir(args, &trace_dir)) {
+    print_help(stderr);
+    return 1;
+  }
+
+  if (!TraceFrameIndex::build(resolve_trace_name(trace_dir))) {
+    fprintf(stderr, "Failed to write frame index\n");
+    return 1;
+  }
+  return 0;
+}
+
+} // namespace rr
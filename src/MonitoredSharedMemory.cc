@@ -2,10 +2,12 @@
 
 #include "MonitoredSharedMemory.h"
 
+#include <fnmatch.h>
 #include <sys/mman.h>
 
 #include "AddressSpace.h"
 #include "AutoRemoteSyscalls.h"
+#include "RecordSession.h"
 #include "RecordTask.h"
 #include "Session.h"
 #include "core.h"
@@ -19,15 +21,28 @@ MonitoredSharedMemory::~MonitoredSharedMemory() { munmap(real_mem, size); }
 
 static const char dconf_suffix[] = "/dconf/user";
 
+static bool should_monitor(RecordTask* t, const string& file_name) {
+  size_t dconf_suffix_len = sizeof(dconf_suffix) - 1;
+  if (file_name.size() >= dconf_suffix_len &&
+      file_name.substr(file_name.size() - dconf_suffix_len) == dconf_suffix) {
+    return true;
+  }
+  for (auto& pattern : t->session().monitored_shared_memory_patterns()) {
+    if (!fnmatch(pattern.c_str(), file_name.c_str(), 0)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 void MonitoredSharedMemory::maybe_monitor(RecordTask* t,
                                           const string& file_name,
                                           const AddressSpace::Mapping& m,
                                           int tracee_fd, uint64_t offset) {
-  size_t dconf_suffix_len = sizeof(dconf_suffix) - 1;
-  if (file_name.size() < dconf_suffix_len ||
-      file_name.substr(file_name.size() - dconf_suffix_len) != dconf_suffix) {
+  if (!should_monitor(t, file_name)) {
     return;
   }
+  LOG(debug) << "Monitoring shared memory " << file_name << " at " << m.map;
 
   AutoRemoteSyscalls remote(t);
 
@@ -72,6 +87,37 @@ void MonitoredSharedMemory::check_all(RecordTask* t) {
   }
 }
 
+bool MonitoredSharedMemory::copy_changed_pages(RecordTask* t,
+                                               AddressSpace::Mapping& m) {
+  uint8_t* local = static_cast<uint8_t*>(m.local_addr);
+  size_t page = page_size();
+  size_t run_start = size;
+  bool copied = false;
+  for (size_t offset = 0; offset <= size; offset += page) {
+    bool changed = false;
+    if (offset < size) {
+      size_t len = min(page, size - offset);
+      changed = memcmp(local + offset, real_mem + offset, len) != 0;
+    }
+    if (changed) {
+      if (run_start == size) {
+        run_start = offset;
+      }
+      continue;
+    }
+    if (run_start < size) {
+      size_t len = min(offset, size) - run_start;
+      memcpy(local + run_start, real_mem + run_start, len);
+      // Record what the tracee now sees; the peer may already have changed
+      // real_mem again.
+      t->record_local(m.map.start() + run_start, len, local + run_start);
+      run_start = size;
+      copied = true;
+    }
+  }
+  return copied;
+}
+
 void MonitoredSharedMemory::check_for_changes(RecordTask* t,
                                               AddressSpace::Mapping& m) {
   ASSERT(t, m.map.size() == size);
@@ -86,10 +132,20 @@ void MonitoredSharedMemory::check_for_changes(RecordTask* t,
       return;
     }
   }
-  if (!memcmp(m.local_addr, real_mem, size)) {
-    return;
+  // Compare a page at a time and only record the runs of pages that
+  // changed, so a small update to a large segment produces a small trace
+  // record. A single pass isn't a consistent snapshot: a peer can write a
+  // page we've already compared and then a later one we haven't, and the
+  // tracee would see the second write without the first. So scan again
+  // until a pass finds nothing new. A peer that never stops writing gets a
+  // bounded number of passes rather than stalling the recording.
+  static const int MAX_PASSES = 16;
+  for (int pass = 0; pass < MAX_PASSES; ++pass) {
+    if (!copy_changed_pages(t, m)) {
+      return;
+    }
   }
-  memcpy(m.local_addr, real_mem, size);
-  t->record_local(m.map.start(), size, real_mem);
+  LOG(debug) << "Shared memory at " << m.map << " still changing after "
+             << MAX_PASSES << " passes";
 }
 }
@@ -13,10 +13,11 @@ class RecordTask;
 
 /**
  * Support tracees that share memory read-only with a non-tracee that
- * writes to the memory. Currently this just supports limited cases that
- * suffice for dconf: no remapping, coalescing or splitting of the memory is
- * allowed (|subrange| below just asserts). It doesn't handle mappings where
- * the mapping has more pages than the file.
+ * writes to the memory. This is always done for dconf's database; other
+ * files can be selected with `rr record --monitor-shared-memory=<PATTERN>`.
+ * Currently this just supports limited cases: no remapping, coalescing or
+ * splitting of the memory is allowed (|subrange| below just asserts). It
+ * doesn't handle mappings where the mapping has more pages than the file.
  *
  * After such memory is mapped in the tracee, we also map it in rr at |real_mem|
  * and replace the tracee's mapping with a "shadow buffer" that's only shared
@@ -26,7 +27,8 @@ class RecordTask;
  *
  * Currently we check the real memory after each syscall exit. This ensures
  * that if the tracee is woken up by some IPC mechanism (or after sched_yield),
- * it will get a chance to see updated memory values.
+ * it will get a chance to see updated memory values. Only the pages that
+ * differ are copied and recorded.
  */
 class MonitoredSharedMemory {
 public:
@@ -44,6 +46,8 @@ public:
 
 private:
   void check_for_changes(RecordTask* t, AddressSpace::Mapping& m);
+  // Copy and record each run of changed pages. Returns true if any changed.
+  bool copy_changed_pages(RecordTask* t, AddressSpace::Mapping& m);
 
   MonitoredSharedMemory(uint8_t* real_mem, size_t size)
       : real_mem(real_mem), size(size) {}
@@ -5,12 +5,15 @@
 #include <limits.h>
 #include <linux/auxvec.h>
 
+#include <set>
 #include <sstream>
+#include <unordered_map>
 
 #include "AddressSpace.h"
 #include "AutoRemoteSyscalls.h"
 #include "ElfReader.h"
 #include "Flags.h"
+#include "PatchSiteCache.h"
 #include "RecordSession.h"
 #include "RecordTask.h"
 #include "ReplaySession.h"
@@ -145,12 +148,324 @@ void Monkeypatcher::init_dynamic_syscall_patching(
   }
 }
 
+/**
+ * An x86-64 instruction that can be moved into a jump stub, possibly after
+ * rewriting it. See decode_relocatable_x64_instruction.
+ */
+struct RelocatableInstruction {
+  enum Kind {
+    // Position-independent; copied as-is.
+    VERBATIM,
+    // Has a RIP-relative memory operand whose disp32 is at |disp_offset|.
+    RIP_RELATIVE,
+    // jmp rel8/rel32. Rewritten as jmp rel32.
+    JUMP,
+    // jcc rel8/rel32. Rewritten as jcc rel32.
+    CONDITIONAL_JUMP,
+  };
+  Kind kind;
+  size_t length;
+  size_t disp_offset;
+  // For JUMP and CONDITIONAL_JUMP, the target relative to the end of the
+  // instruction.
+  int32_t rel;
+  uint8_t condition;
+  // Execution never falls through to the following instruction.
+  bool terminal;
+
+  // The size of the instruction once relocated.
+  size_t relocated_length() const {
+    switch (kind) {
+      case JUMP:
+        return 5;
+      case CONDITIONAL_JUMP:
+        return 6;
+      default:
+        return length;
+    }
+  }
+};
+
+static bool decode_x64_modrm(const uint8_t* code, size_t len, size_t* pos,
+                             uint8_t* reg, RelocatableInstruction* insn) {
+  if (*pos >= len) {
+    return false;
+  }
+  uint8_t modrm = code[(*pos)++];
+  uint8_t mod = modrm >> 6;
+  uint8_t rm = modrm & 7;
+  *reg = (modrm >> 3) & 7;
+  if (mod == 3) {
+    return true;
+  }
+  if (rm == 4) {
+    if (*pos >= len) {
+      return false;
+    }
+    uint8_t sib = code[(*pos)++];
+    if (mod == 0 && (sib & 7) == 5) {
+      *pos += 4;
+    }
+  } else if (mod == 0 && rm == 5) {
+    insn->kind = RelocatableInstruction::RIP_RELATIVE;
+    insn->disp_offset = *pos;
+    *pos += 4;
+  }
+  if (mod == 1) {
+    *pos += 1;
+  } else if (mod == 2) {
+    *pos += 4;
+  }
+  return *pos <= len;
+}
+
+/**
+ * Decode the instruction at |code|, if it's one we know how to relocate.
+ * This deliberately only understands common integer and SSE move
+ * instructions, plus direct jumps. Anything else, in particular calls,
+ * returns, traps and instructions that use the address-size prefix, makes
+ * this return false.
+ */
+static bool decode_relocatable_x64_instruction(const uint8_t* code, size_t len,
+                                               RelocatableInstruction* insn) {
+  len = min<size_t>(len, 15);
+  insn->kind = RelocatableInstruction::VERBATIM;
+  insn->terminal = false;
+  size_t pos = 0;
+  bool operand_size_16 = false;
+  bool rex_w = false;
+  while (pos < len) {
+    uint8_t b = code[pos];
+    if (b == 0x66) {
+      operand_size_16 = true;
+    } else if (b != 0xf0 && b != 0xf2 && b != 0xf3 && b != 0x26 &&
+               b != 0x2e && b != 0x36 && b != 0x3e && b != 0x64 &&
+               b != 0x65) {
+      break;
+    }
+    ++pos;
+  }
+  if (pos < len && (code[pos] & 0xf0) == 0x40) {
+    rex_w = code[pos] & 0x08;
+    ++pos;
+  }
+  if (pos >= len) {
+    return false;
+  }
+  uint8_t op = code[pos++];
+  size_t imm_size = operand_size_16 ? 2 : 4;
+  size_t imm = 0;
+  bool has_modrm = false;
+  uint8_t reg = 0;
+  if (op == 0x0f) {
+    if (pos >= len) {
+      return false;
+    }
+    uint8_t op2 = code[pos++];
+    if (op2 >= 0x80 && op2 <= 0x8f) {
+      insn->kind = RelocatableInstruction::CONDITIONAL_JUMP;
+      insn->condition = op2 & 0xf;
+      imm = 4;
+    } else if (op2 == 0x10 || op2 == 0x11 || (op2 >= 0x18 && op2 <= 0x1f) ||
+               op2 == 0x28 ||
+               op2 == 0x29 || (op2 >= 0x40 && op2 <= 0x4f) ||
+               op2 == 0x6e || op2 == 0x6f || op2 == 0x7e || op2 == 0x7f ||
+               (op2 >= 0x90 && op2 <= 0x9f) || op2 == 0xa3 || op2 == 0xaf ||
+               op2 == 0xb0 || op2 == 0xb1 || op2 == 0xb6 || op2 == 0xb7 ||
+               op2 == 0xbe || op2 == 0xbf || op2 == 0xc0 || op2 == 0xc1 ||
+               op2 == 0xd6 || op2 == 0xef) {
+      has_modrm = true;
+    } else if (op2 == 0xba) {
+      has_modrm = true;
+      imm = 1;
+    } else {
+      return false;
+    }
+  } else if (op < 0x40 && (op & 7) < 6) {
+    // add/or/adc/sbb/and/sub/xor/cmp in all their forms.
+    switch (op & 7) {
+      case 4:
+        imm = 1;
+        break;
+      case 5:
+        imm = imm_size;
+        break;
+      default:
+        has_modrm = true;
+        break;
+    }
+  } else if ((op >= 0x50 && op <= 0x5f) || (op >= 0x90 && op <= 0x99)) {
+    // push/pop reg, nop/xchg, cbw/cwd and friends.
+  } else if (op == 0x63 || (op >= 0x84 && op <= 0x8b) || op == 0x8d ||
+             op == 0x8f || (op >= 0xd0 && op <= 0xd3)) {
+    has_modrm = true;
+  } else if (op == 0x68) {
+    imm = imm_size;
+  } else if (op == 0x6a || op == 0xa8 || (op >= 0xb0 && op <= 0xb7)) {
+    imm = 1;
+  } else if (op == 0x69 || op == 0x81 || op == 0xc7) {
+    has_modrm = true;
+    imm = imm_size;
+  } else if (op == 0x6b || op == 0x80 || op == 0x83 || op == 0xc0 ||
+             op == 0xc1 || op == 0xc6) {
+    has_modrm = true;
+    imm = 1;
+  } else if (op == 0xa9) {
+    imm = imm_size;
+  } else if (op >= 0xb8 && op <= 0xbf) {
+    imm = rex_w ? 8 : imm_size;
+  } else if (op >= 0x70 && op <= 0x7f) {
+    insn->kind = RelocatableInstruction::CONDITIONAL_JUMP;
+    insn->condition = op & 0xf;
+    imm = 1;
+  } else if (op == 0xe9 || op == 0xeb) {
+    insn->kind = RelocatableInstruction::JUMP;
+    insn->terminal = true;
+    imm = op == 0xe9 ? 4 : 1;
+  } else if (op == 0xf6 || op == 0xf7 || op == 0xfe || op == 0xff) {
+    if (!decode_x64_modrm(code, len, &pos, &reg, insn)) {
+      return false;
+    }
+    if (op == 0xf6 || op == 0xf7) {
+      // test has an immediate; not/neg/mul/div etc don't.
+      if (reg < 2) {
+        imm = op == 0xf6 ? 1 : imm_size;
+      }
+    } else if (op == 0xfe ? reg > 1 : (reg != 0 && reg != 1 && reg != 4 &&
+                                       reg != 6)) {
+      // Calls and far jumps.
+      return false;
+    } else if (reg == 4) {
+      // Indirect jmp.
+      insn->terminal = true;
+    }
+  } else {
+    return false;
+  }
+  if (has_modrm && !decode_x64_modrm(code, len, &pos, &reg, insn)) {
+    return false;
+  }
+  if ((op == 0xc6 || op == 0xc7) && reg != 0) {
+    // Only /0 is mov. c7 /7 is XBEGIN, whose operand is IP-relative.
+    return false;
+  }
+  if (pos + imm > len) {
+    return false;
+  }
+  if (insn->kind == RelocatableInstruction::JUMP ||
+      insn->kind == RelocatableInstruction::CONDITIONAL_JUMP) {
+    if (imm == 1) {
+      insn->rel = (int8_t)code[pos];
+    } else {
+      memcpy(&insn->rel, code + pos, 4);
+    }
+  }
+  insn->length = pos + imm;
+  return true;
+}
+
+/**
+ * Decode whole instructions from |code| (the bytes following a syscall
+ * instruction) until at least |min_length| bytes are covered. Returns the
+ * number of bytes covered, or 0 if any of them can't be relocated.
+ */
+static size_t decode_relocatable_x64_instructions(
+    const uint8_t* code, size_t len, size_t min_length,
+    vector<RelocatableInstruction>* insns) {
+  size_t pos = 0;
+  while (pos < min_length) {
+    RelocatableInstruction insn;
+    if (!decode_relocatable_x64_instruction(code + pos, len - pos, &insn)) {
+      return 0;
+    }
+    pos += insn.length;
+    insns->push_back(insn);
+    if (insn.terminal && pos < min_length) {
+      // The bytes after this may belong to some other code.
+      return 0;
+    }
+  }
+  return pos;
+}
+
+/**
+ * Write the relocated form of the |length| bytes of instructions at
+ * |orig_addr| (which were read into |code|) to |out|, to run at |new_addr|,
+ * followed by a jump back to the instruction after them. Fails if a branch
+ * or RIP-relative operand can't reach its target from |new_addr|, or a branch
+ * targets the instructions being relocated or the syscall before them.
+ */
+static bool relocate_x64_instructions(const uint8_t* code, size_t length,
+                                      remote_ptr<uint8_t> orig_addr,
+                                      remote_ptr<uint8_t> new_addr,
+                                      size_t syscall_length,
+                                      vector<uint8_t>* out) {
+  vector<RelocatableInstruction> insns;
+  if (decode_relocatable_x64_instructions(code, length, length, &insns) !=
+      length) {
+    return false;
+  }
+  size_t pos = 0;
+  for (const auto& insn : insns) {
+    remote_ptr<uint8_t> orig_pc = orig_addr + pos;
+    remote_ptr<uint8_t> new_pc = new_addr + out->size();
+    int64_t delta;
+    switch (insn.kind) {
+      case RelocatableInstruction::VERBATIM:
+        out->insert(out->end(), code + pos, code + pos + insn.length);
+        break;
+      case RelocatableInstruction::RIP_RELATIVE: {
+        int32_t disp;
+        memcpy(&disp, code + pos + insn.disp_offset, sizeof(disp));
+        delta = disp + (orig_pc - new_pc);
+        if ((int32_t)delta != delta) {
+          return false;
+        }
+        size_t start = out->size();
+        out->insert(out->end(), code + pos, code + pos + insn.length);
+        int32_t new_disp = (int32_t)delta;
+        memcpy(out->data() + start + insn.disp_offset, &new_disp,
+               sizeof(new_disp));
+        break;
+      }
+      case RelocatableInstruction::JUMP:
+      case RelocatableInstruction::CONDITIONAL_JUMP: {
+        remote_ptr<uint8_t> target = orig_pc + insn.length + insn.rel;
+        if (orig_addr - syscall_length <= target &&
+            target < orig_addr + length) {
+          return false;
+        }
+        delta = target - (new_pc + insn.relocated_length());
+        if ((int32_t)delta != delta) {
+          return false;
+        }
+        if (insn.kind == RelocatableInstruction::JUMP) {
+          out->push_back(0xe9);
+        } else {
+          out->push_back(0x0f);
+          out->push_back(0x80 | insn.condition);
+        }
+        int32_t rel32 = (int32_t)delta;
+        const uint8_t* rel_bytes = reinterpret_cast<const uint8_t*>(&rel32);
+        out->insert(out->end(), rel_bytes, rel_bytes + sizeof(rel32));
+        break;
+      }
+    }
+    pos += insn.length;
+  }
+  uint8_t jump_back[X64SyscallStubRestore::size];
+  X64SyscallStubRestore::substitute(jump_back, (orig_addr + length).as_int());
+  out->insert(out->end(), jump_back, jump_back + sizeof(jump_back));
+  return true;
+}
+
 template <typename Arch>
 static bool patch_syscall_with_hook_arch(Monkeypatcher& patcher, RecordTask* t,
                                          const syscall_patch_hook& hook,
                                          remote_code_ptr ip_of_instruction,
                                          size_t instruction_length,
-                                         uint32_t fake_syscall_number);
+                                         uint32_t fake_syscall_number,
+                                         size_t relocate_length);
 
 template <typename StubPatch>
 static void substitute(uint8_t* buffer, uint64_t return_addr,
@@ -210,18 +525,19 @@ void substitute_extended_jump<X64TrapInstructionStubExtendedJump>(
 /**
  * Allocate an extended jump in an extended jump page and return its address.
  * The resulting address must be within 2G of from_end, and the instruction
- * there must jump to to_start.
+ * there must jump to to_start. |extra_bytes| more bytes are reserved
+ * immediately after the extended jump.
  */
 template <typename ExtendedJumpPatch>
 static remote_ptr<uint8_t> allocate_extended_jump_x86ish(
     RecordTask* t, vector<Monkeypatcher::ExtendedJumpPage>& pages,
-    remote_ptr<uint8_t> from_end) {
+    remote_ptr<uint8_t> from_end, size_t extra_bytes = 0) {
+  size_t size = ExtendedJumpPatch::size + extra_bytes;
   Monkeypatcher::ExtendedJumpPage* page = nullptr;
   for (auto& p : pages) {
     remote_ptr<uint8_t> page_jump_start = p.addr + p.allocated;
     int64_t offset = page_jump_start - from_end;
-    if ((int32_t)offset == offset &&
-        p.allocated + ExtendedJumpPatch::size <= page_size()) {
+    if ((int32_t)offset == offset && p.allocated + size <= page_size()) {
       page = &p;
       break;
     }
@@ -274,7 +590,7 @@ static remote_ptr<uint8_t> allocate_extended_jump_x86ish(
   }
 
   remote_ptr<uint8_t> jump_addr = page->addr + page->allocated;
-  page->allocated += ExtendedJumpPatch::size;
+  page->allocated += size;
   return jump_addr;
 }
 
@@ -514,6 +830,12 @@ remote_code_ptr Monkeypatcher::get_jump_stub_exit_breakpoint(remote_code_ptr ip,
  *
  * If fake_syscall_number > 0 then we'll ensure AX is set to that number
  * by the stub code.
+ *
+ * If relocate_length > 0 then |hook| is a PATCH_IS_NOP_INSTRUCTIONS hook and
+ * the relocate_length bytes of instructions after the syscall don't match
+ * any hook. We copy them, rewritten where necessary, to just after the stub,
+ * followed by a jump back to the original code, and have the hook return
+ * there (x86-64 only).
  */
 template <typename JumpPatch, typename ExtendedJumpPatch, typename FakeSyscallExtendedJumpPatch>
 static bool patch_syscall_with_hook_x86ish(Monkeypatcher& patcher,
@@ -521,8 +843,11 @@ static bool patch_syscall_with_hook_x86ish(Monkeypatcher& patcher,
                                            const syscall_patch_hook& hook,
                                            remote_code_ptr ip_of_instruction,
                                            size_t instruction_length,
-                                           uint32_t fake_syscall_number) {
-  uint8_t jump_patch[instruction_length + hook.patch_region_length];
+                                           uint32_t fake_syscall_number,
+                                           size_t relocate_length) {
+  size_t patch_region_length =
+      relocate_length ? relocate_length : hook.patch_region_length;
+  uint8_t jump_patch[instruction_length + patch_region_length];
   // We're patching in a relative jump, so we need to compute the offset from
   // the end of the jump to our actual destination.
   remote_ptr<uint8_t> jump_patch_start = ip_of_instruction.to_data_ptr<uint8_t>();
@@ -531,7 +856,27 @@ static bool patch_syscall_with_hook_x86ish(Monkeypatcher& patcher,
   }
   remote_ptr<uint8_t> jump_patch_end = jump_patch_start + JumpPatch::size;
   remote_ptr<uint8_t> return_addr =
-    jump_patch_start + instruction_length + hook.patch_region_length;
+    jump_patch_start + instruction_length + patch_region_length;
+
+  uint8_t original_code[32];
+  size_t relocated_size = 0;
+  if (relocate_length) {
+    ASSERT(t, t->arch() == x86_64 &&
+              (hook.flags & PATCH_IS_NOP_INSTRUCTIONS) &&
+              !fake_syscall_number &&
+              relocate_length <= sizeof(original_code));
+    if (t->read_bytes_fallible(return_addr - relocate_length, relocate_length,
+                               original_code) != (ssize_t)relocate_length) {
+      return false;
+    }
+    vector<RelocatableInstruction> insns;
+    decode_relocatable_x64_instructions(original_code, relocate_length,
+                                        relocate_length, &insns);
+    for (const auto& insn : insns) {
+      relocated_size += insn.relocated_length();
+    }
+    relocated_size += X64SyscallStubRestore::size;
+  }
 
   remote_ptr<uint8_t> extended_jump_start;
   if (fake_syscall_number) {
@@ -539,12 +884,32 @@ static bool patch_syscall_with_hook_x86ish(Monkeypatcher& patcher,
         t, patcher.extended_jump_pages, jump_patch_end);
   } else {
     extended_jump_start = allocate_extended_jump_x86ish<ExtendedJumpPatch>(
-          t, patcher.extended_jump_pages, jump_patch_end);
+          t, patcher.extended_jump_pages, jump_patch_end, relocated_size);
   }
   if (extended_jump_start.is_null()) {
     return false;
   }
 
+  if (relocate_length) {
+    remote_ptr<uint8_t> relocated_start =
+        extended_jump_start + ExtendedJumpPatch::size;
+    vector<uint8_t> relocated;
+    if (!relocate_x64_instructions(original_code, relocate_length,
+                                   return_addr - relocate_length,
+                                   relocated_start, instruction_length,
+                                   &relocated)) {
+      // The stub space we allocated is wasted, but this is rare.
+      LOG(debug) << "Can't relocate instructions at "
+                 << return_addr - relocate_length << " to " << relocated_start;
+      return false;
+    }
+    ASSERT(t, relocated.size() == relocated_size);
+    write_and_record_bytes(t, relocated_start, relocated.size(),
+                           relocated.data());
+    // The hook returns to the relocated instructions, which jump back.
+    return_addr = relocated_start;
+  }
+
   if (fake_syscall_number) {
     uint8_t stub_patch[FakeSyscallExtendedJumpPatch::size];
     substitute_extended_jump<FakeSyscallExtendedJumpPatch>(stub_patch,
@@ -590,14 +955,16 @@ bool patch_syscall_with_hook_arch<X86Arch>(Monkeypatcher& patcher,
                                            const syscall_patch_hook& hook,
                                            remote_code_ptr ip_of_instruction,
                                            size_t instruction_length,
-                                           uint32_t fake_syscall_number) {
+                                           uint32_t fake_syscall_number,
+                                           size_t relocate_length) {
   return patch_syscall_with_hook_x86ish<X86SysenterVsyscallSyscallHook,
                                         X86SyscallStubExtendedJump,
                                         X86TrapInstructionStubExtendedJump>(patcher, t,
                                                                             hook,
                                                                             ip_of_instruction,
                                                                             instruction_length,
-                                                                            fake_syscall_number);
+                                                                            fake_syscall_number,
+                                                                            relocate_length);
 }
 
 template <>
@@ -606,14 +973,16 @@ bool patch_syscall_with_hook_arch<X64Arch>(Monkeypatcher& patcher,
                                            const syscall_patch_hook& hook,
                                            remote_code_ptr ip_of_instruction,
                                            size_t instruction_length,
-                                           uint32_t fake_syscall_number) {
+                                           uint32_t fake_syscall_number,
+                                           size_t relocate_length) {
   return patch_syscall_with_hook_x86ish<X64JumpMonkeypatch,
                                         X64SyscallStubExtendedJump,
                                         X64TrapInstructionStubExtendedJump>(patcher, t,
                                                                             hook,
                                                                             ip_of_instruction,
                                                                             instruction_length,
-                                                                            fake_syscall_number);
+                                                                            fake_syscall_number,
+                                                                            relocate_length);
 }
 
 template <>
@@ -622,7 +991,8 @@ bool patch_syscall_with_hook_arch<ARM64Arch>(Monkeypatcher& patcher,
                                              const syscall_patch_hook &hook,
                                              remote_code_ptr,
                                              size_t,
-                                             uint32_t) {
+                                             uint32_t,
+                                             size_t) {
   Registers r = t->regs();
   remote_ptr<uint8_t> svc_ip = r.ip().to_data_ptr<uint8_t>();
   std::vector<uint32_t> inst_buff;
@@ -681,9 +1051,11 @@ static bool patch_syscall_with_hook(Monkeypatcher& patcher, RecordTask* t,
                                     const syscall_patch_hook& hook,
                                     remote_code_ptr ip_of_instruction,
                                     size_t instruction_length,
-                                    uint32_t fake_syscall_number) {
+                                    uint32_t fake_syscall_number,
+                                    size_t relocate_length = 0) {
   RR_ARCH_FUNCTION(patch_syscall_with_hook_arch, t->arch(), patcher, t, hook,
-                   ip_of_instruction, instruction_length, fake_syscall_number);
+                   ip_of_instruction, instruction_length, fake_syscall_number,
+                   relocate_length);
 }
 
 template <typename ExtendedJumpPatch>
@@ -951,10 +1323,44 @@ bool Monkeypatcher::try_patch_vsyscall_caller(RecordTask* t, remote_code_ptr ret
   return true;
 }
 
+/**
+ * Search |bytes| for a short conditional or unconditional jump that targets
+ * an instruction boundary inside the patch region that starts at
+ * |region_offset|. If |multiple_instructions| is false, the only boundary
+ * inside the region is its start. False positives are OK.
+ */
+static bool has_potential_interfering_branch(remote_code_ptr ip,
+                                             const uint8_t* bytes,
+                                             size_t buf_valid_start_offset,
+                                             size_t buf_valid_end_offset,
+                                             size_t region_offset,
+                                             size_t region_length,
+                                             bool multiple_instructions,
+                                             intptr_t look_back) {
+  for (size_t i = buf_valid_start_offset; i + 2 <= buf_valid_end_offset; ++i) {
+    uint8_t b = bytes[i];
+    // Check for short conditional or unconditional jump
+    if (b == 0xeb || (b >= 0x70 && b < 0x80)) {
+      int offset_from_instruction_end = (int)i + 2 + (int8_t)bytes[i + 1] -
+          (int)region_offset;
+      if (multiple_instructions
+              ? (offset_from_instruction_end >= 0 &&
+                 offset_from_instruction_end < (int)region_length)
+              : offset_from_instruction_end == 0) {
+        LOG(debug) << "Found potential interfering branch at "
+                   << ip.to_data_ptr<uint8_t>() - look_back + i;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
 const syscall_patch_hook* Monkeypatcher::find_syscall_hook(RecordTask* t,
                                                            remote_code_ptr ip,
                                                            bool entering_syscall,
-                                                           size_t instruction_length) {
+                                                           size_t instruction_length,
+                                                           size_t* relocate_length) {
   /* we need to inspect this many bytes before the start of the instruction,
      to find every short jump that might land after it. Conservative. */
   static const intptr_t LOOK_BACK = 0x80;
@@ -1022,27 +1428,13 @@ const syscall_patch_hook* Monkeypatcher::find_syscall_hook(RecordTask* t,
 
     // Search for a following short-jump instruction that targets an
     // instruction
-    // after the syscall. False positives are OK.
+    // after the syscall. We can't patch if there is one because it would
+    // jump straight back into the middle of our patch code.
     // glibc-2.23.1-8.fc24.x86_64's __clock_nanosleep needs this.
-    bool found_potential_interfering_branch = false;
-    for (size_t i = buf_valid_start_offset; i + 2 <= buf_valid_end_offset; ++i) {
-      uint8_t b = bytes[i];
-      // Check for short conditional or unconditional jump
-      if (b == 0xeb || (b >= 0x70 && b < 0x80)) {
-        int offset_from_instruction_end = (int)i + 2 + (int8_t)bytes[i + 1] -
-            (LOOK_BACK + instruction_length);
-        if ((hook.flags & PATCH_IS_MULTIPLE_INSTRUCTIONS)
-                ? (offset_from_instruction_end >= 0 && offset_from_instruction_end < hook.patch_region_length)
-                : offset_from_instruction_end == 0) {
-          LOG(debug) << "Found potential interfering branch at "
-                      << ip.to_data_ptr<uint8_t>() - LOOK_BACK + i;
-          // We can't patch this because it would jump straight back into
-          // the middle of our patch code.
-          found_potential_interfering_branch = true;
-          break;
-        }
-      }
-    }
+    bool found_potential_interfering_branch = has_potential_interfering_branch(
+        ip, bytes, buf_valid_start_offset, buf_valid_end_offset,
+        LOOK_BACK + instruction_length, hook.patch_region_length,
+        hook.flags & PATCH_IS_MULTIPLE_INSTRUCTIONS, LOOK_BACK);
 
     if (!found_potential_interfering_branch) {
       remote_code_ptr start_range, end_range;
@@ -1075,7 +1467,51 @@ const syscall_patch_hook* Monkeypatcher::find_syscall_hook(RecordTask* t,
                     min<size_t>(following_bytes_count,
                         sizeof(syscall_patch_hook::patch_region_bytes)));
 
-  return nullptr;
+  if (!relocate_length || t->arch() != x86_64 ||
+      !t->session().relocate_patched_instructions()) {
+    return nullptr;
+  }
+  // No hook knows these instructions, so try moving them into the jump stub
+  // instead and using a hook that executes nothing after the syscall.
+  const syscall_patch_hook* nop_hook = nullptr;
+  for (const auto& hook : syscall_hooks) {
+    if (hook.flags & PATCH_IS_NOP_INSTRUCTIONS) {
+      nop_hook = &hook;
+      break;
+    }
+  }
+  if (!nop_hook) {
+    return nullptr;
+  }
+  vector<RelocatableInstruction> insns;
+  size_t length = decode_relocatable_x64_instructions(
+      following_bytes, following_bytes_count,
+      X64JumpMonkeypatch::size - instruction_length, &insns);
+  if (!length) {
+    LOG(debug) << "Can't relocate the instructions after syscall at " << ip;
+    return nullptr;
+  }
+  if (has_potential_interfering_branch(ip, bytes, buf_valid_start_offset,
+                                       buf_valid_end_offset,
+                                       LOOK_BACK + instruction_length, length,
+                                       true, LOOK_BACK) ||
+      !safe_for_syscall_patching(ip, ip + instruction_length + length, t)) {
+    return nullptr;
+  }
+  // Unless we're about to restart the syscall, t's own ip may be inside the
+  // jump we'd write (e.g. just after the syscall, at syscall exit), and
+  // safe_for_syscall_patching doesn't check t.
+  if (!entering_syscall &&
+      !task_safe_for_syscall_patching(t, ip, ip + instruction_length + length)) {
+    LOG(debug) << "Declining to relocate instructions after syscall at " << ip
+               << " because tid " << t->tid << " is in the patched range";
+    return nullptr;
+  }
+  LOG(debug) << "Relocating " << insns.size() << " instruction(s) after "
+             << "syscall at " << ip << ": "
+             << bytes_to_string(following_bytes, length);
+  *relocate_length = length;
+  return nop_hook;
 }
 
 // Syscalls can be patched either on entry or exit. For most syscall
@@ -1093,8 +1529,9 @@ bool Monkeypatcher::try_patch_syscall_x86ish(RecordTask* t, bool entering_syscal
   ASSERT(t, is_x86ish(arch)) << "Unsupported architecture";
 
   size_t instruction_length = rr::syscall_instruction_length(arch);
+  size_t relocate_length = 0;
   const syscall_patch_hook* hook_ptr = find_syscall_hook(t, ip - instruction_length,
-      entering_syscall, instruction_length);
+      entering_syscall, instruction_length, &relocate_length);
   bool success = false;
   intptr_t syscallno = r.original_syscallno();
   if (hook_ptr) {
@@ -1106,11 +1543,15 @@ bool Monkeypatcher::try_patch_syscall_x86ish(RecordTask* t, bool entering_syscal
     LOG(debug) << "Patching syscall at " << ip << " syscall "
                << syscall_name(syscallno, t->arch()) << " tid " << t->tid;
 
-    success = patch_syscall_with_hook(*this, t, *hook_ptr, ip - instruction_length, instruction_length, 0);
+    success = patch_syscall_with_hook(*this, t, *hook_ptr, ip - instruction_length,
+                                      instruction_length, 0, relocate_length);
     if (!success && entering_syscall) {
       // Need to reenter the syscall to undo exit_syscall_and_prepare_restart
       t->enter_syscall();
     }
+    if (success) {
+      note_patched_site(t, ip - instruction_length);
+    }
   }
 
   if (!success) {
@@ -1245,6 +1686,124 @@ bool Monkeypatcher::try_patch_syscall(RecordTask* t, bool entering_syscall) {
   return try_patch_syscall_x86ish(t, entering_syscall, arch);
 }
 
+void Monkeypatcher::note_patched_site(RecordTask* t, remote_code_ptr ip) {
+  PatchSiteCache* cache = t->session().patch_site_cache();
+  remote_ptr<void> addr = ip.to_data_ptr<void>();
+  if (!cache || !t->vm()->has_mapping(addr)) {
+    return;
+  }
+  const KernelMapping& km = t->vm()->mapping_of(addr).map;
+  string build_id = cache->build_id(km);
+  if (build_id.empty()) {
+    return;
+  }
+  cache->add_site(build_id, t->arch(),
+                  km.file_offset_bytes() + (addr - km.start()));
+}
+
+bool Monkeypatcher::try_patch_cached_site(RecordTask* t, remote_code_ptr ip) {
+  size_t instruction_length = rr::syscall_instruction_length(t->arch());
+  remote_code_ptr after_syscall = ip + instruction_length;
+  if (tried_to_patch_syscall_addresses.count(after_syscall) ||
+      is_jump_stub_instruction(after_syscall, true)) {
+    return false;
+  }
+  // The cache may be out of date, or the tracee may have rewritten its code,
+  // so check that this is still a patchable syscall.
+  SupportedArch arch;
+  if (!get_syscall_instruction_arch(t, ip, &arch) || arch != t->arch()) {
+    LOG(debug) << "Cached patch site " << ip << " is not a syscall";
+    return false;
+  }
+  size_t relocate_length = 0;
+  const syscall_patch_hook* hook_ptr =
+      find_syscall_hook(t, ip, false, instruction_length, &relocate_length);
+  if (!hook_ptr) {
+    return false;
+  }
+  // find_syscall_hook only checks that other tasks are out of the way.
+  remote_code_ptr start_range = ip;
+  remote_code_ptr end_range =
+      ip + instruction_length +
+      (relocate_length ? relocate_length : hook_ptr->patch_region_length);
+  if (hook_ptr->flags & PATCH_SYSCALL_INSTRUCTION_IS_LAST) {
+    start_range = ip - hook_ptr->patch_region_length;
+    end_range = ip + instruction_length;
+  }
+  if (!task_safe_for_syscall_patching(t, start_range, end_range)) {
+    return false;
+  }
+
+  LOG(debug) << "Patching cached syscall site at " << ip << " tid " << t->tid;
+  if (!patch_syscall_with_hook(*this, t, *hook_ptr, ip, instruction_length,
+                               0, relocate_length)) {
+    tried_to_patch_syscall_addresses.insert(after_syscall);
+    return false;
+  }
+  return true;
+}
+
+bool Monkeypatcher::apply_cached_patch_sites(RecordTask* t) {
+  if (pending_cached_site_ranges.empty() || syscall_hooks.empty()) {
+    // If the syscall hooks aren't set up yet, keep the ranges until they are.
+    return false;
+  }
+  if (t->emulated_ptracer) {
+    // Patching can confuse ptracers.
+    return false;
+  }
+
+  PatchSiteCache* cache = t->session().patch_site_cache();
+  vector<MemoryRange> ranges;
+  ranges.swap(pending_cached_site_ranges);
+  // Find all the sites before patching anything, since patching can map
+  // stub pages.
+  vector<remote_code_ptr> sites;
+  for (const auto& range : ranges) {
+    for (const auto& m : t->vm()->maps_containing_or_after(range.start())) {
+      const KernelMapping& km = m.map;
+      if (km.start() >= range.end()) {
+        break;
+      }
+      if (!(km.prot() & PROT_EXEC) ||
+          (m.flags & AddressSpace::Mapping::IS_PATCH_STUBS)) {
+        continue;
+      }
+      string build_id = cache->build_id(km);
+      if (build_id.empty()) {
+        continue;
+      }
+      const set<uint64_t>& offsets = cache->sites(build_id, t->arch());
+      uint64_t map_offset = km.file_offset_bytes();
+      for (auto it = offsets.lower_bound(map_offset);
+           it != offsets.end() && *it < map_offset + km.size(); ++it) {
+        remote_ptr<void> addr = km.start() + (*it - map_offset);
+        if (range.contains(addr)) {
+          sites.push_back(remote_code_ptr(addr.as_int()));
+        }
+      }
+    }
+  }
+  if (sites.empty()) {
+    return false;
+  }
+
+  // Emit FLUSH_SYSCALLBUF if there's one pending.
+  // We want our mmap records to be associated with the next (PATCH_SYSCALL)
+  // event, not a FLUSH_SYSCALLBUF event.
+  t->maybe_flush_syscallbuf();
+
+  size_t patched = 0;
+  for (auto ip : sites) {
+    if (try_patch_cached_site(t, ip)) {
+      ++patched;
+    }
+  }
+  LOG(debug) << "Patched " << patched << " of " << sites.size()
+             << " cached syscall sites in " << t->tid;
+  return patched > 0;
+}
+
 bool Monkeypatcher::try_patch_trapping_instruction(RecordTask* t, size_t instruction_length,
                                                    bool before_instruction) {
   if (syscall_hooks.empty()) {
@@ -1413,14 +1972,10 @@ void Monkeypatcher::patch_at_preload_init(RecordTask* t) {
   RR_ARCH_FUNCTION(patch_at_preload_init_arch, t->arch(), t, *this);
 }
 
-static remote_ptr<void> resolve_address(ElfReader& reader, uintptr_t elf_addr,
+static remote_ptr<void> resolve_address(uintptr_t file_offset,
                                         remote_ptr<void> map_start,
                                         size_t map_size,
                                         uintptr_t map_offset) {
-  uintptr_t file_offset;
-  if (!reader.addr_to_offset(elf_addr, file_offset)) {
-    LOG(warn) << "ELF address " << HEX(elf_addr) << " not in file";
-  }
   if (file_offset < map_offset || file_offset + 32 > map_offset + map_size) {
     // The value(s) to be set are outside the mapped range. This happens
     // because code and data can be mapped in separate, partial mmaps in which
@@ -1430,15 +1985,8 @@ static remote_ptr<void> resolve_address(ElfReader& reader, uintptr_t elf_addr,
   return map_start + uintptr_t(file_offset - map_offset);
 }
 
-static void set_and_record_bytes(RecordTask* t, ElfReader& reader,
-                                 uintptr_t elf_addr, const void* bytes,
-                                 size_t size, remote_ptr<void> map_start,
-                                 size_t map_size, size_t map_offset) {
-  remote_ptr<void> addr =
-    resolve_address(reader, elf_addr, map_start, map_size, map_offset);
-  if (!addr) {
-    return;
-  }
+static void set_and_record_bytes(RecordTask* t, remote_ptr<void> addr,
+                                 const void* bytes, size_t size) {
   bool ok = true;
   t->write_bytes_helper(addr, size, bytes, &ok);
   // Writing can fail when the value appears to be in the mapped range, but it
@@ -1454,19 +2002,10 @@ static void set_and_record_bytes(RecordTask* t, ElfReader& reader,
  * into stack memory.
  */
 static void patch_dl_runtime_resolve(Monkeypatcher& patcher,
-                                     RecordTask* t, ElfReader& reader,
-                                     uintptr_t elf_addr,
-                                     remote_ptr<void> map_start,
-                                     size_t map_size,
-                                     size_t map_offset) {
+                                     RecordTask* t, remote_ptr<void> addr) {
   if (t->arch() != x86_64) {
     return;
   }
-  remote_ptr<void> addr =
-    resolve_address(reader, elf_addr, map_start, map_size, map_offset);
-  if (!addr) {
-    return;
-  }
 
   uint8_t impl[X64DLRuntimeResolve::size + X64EndBr::size];
   uint8_t *impl_start = impl;
@@ -1515,6 +2054,88 @@ static void patch_dl_runtime_resolve(Monkeypatcher& patcher,
                        sizeof(nops));
 }
 
+namespace {
+
+/**
+ * A patch that patch_after_mmap applies to libpthread or ld.so, located by
+ * symbol lookup.
+ */
+struct LibraryPatch {
+  enum Type { ELISION_ACONF, ELISION_INIT, DL_RUNTIME_RESOLVE };
+  Type type;
+  uintptr_t file_offset;
+};
+
+} // namespace
+
+static void find_library_patches(ElfFileReader& reader,
+                                 const string& file_name,
+                                 SupportedArch arch,
+                                 vector<LibraryPatch>& patches) {
+  // Check for symbols first in the library itself, regardless of whether
+  // there is a debuglink.  For example, on Fedora 26, the .symtab and
+  // .strtab sections are stripped from the debuginfo file for
+  // libpthread.so.
+  SymbolTable syms = reader.read_symbols(".symtab", ".strtab");
+  if (syms.size() == 0) {
+    ScopedFd debug_fd = reader.open_debug_file(file_name);
+    if (debug_fd.is_open()) {
+      ElfFileReader debug_reader(debug_fd, arch);
+      syms = debug_reader.read_symbols(".symtab", ".strtab");
+    }
+  }
+  for (size_t i = 0; i < syms.size(); ++i) {
+    LibraryPatch patch;
+    uintptr_t elf_addr = syms.addr(i);
+    if (syms.is_name(i, "__elision_aconf")) {
+      patch.type = LibraryPatch::ELISION_ACONF;
+      elf_addr += 8;
+    } else if (syms.is_name(i, "elision_init")) {
+      patch.type = LibraryPatch::ELISION_INIT;
+    } else if (syms.is_name(i, "_dl_runtime_resolve_fxsave") ||
+               syms.is_name(i, "_dl_runtime_resolve_xsave") ||
+               syms.is_name(i, "_dl_runtime_resolve_xsavec")) {
+      patch.type = LibraryPatch::DL_RUNTIME_RESOLVE;
+    } else {
+      continue;
+    }
+    if (!reader.addr_to_offset(elf_addr, patch.file_offset)) {
+      LOG(warn) << "ELF address " << HEX(elf_addr) << " not in file";
+      continue;
+    }
+    patches.push_back(patch);
+  }
+}
+
+/**
+ * Returns the patches to apply to the library open in |fd|. Finding them
+ * means reading the whole symbol table, possibly from a separate debug file,
+ * and every exec maps ld.so, so the results are cached by build-id for the
+ * lifetime of rr. This takes most of the ELF work out of exec for
+ * short-lived processes.
+ */
+static vector<LibraryPatch> library_patches(ScopedFd& fd, SupportedArch arch,
+                                            const string& file_name) {
+  static unordered_map<string, vector<LibraryPatch>> cache;
+
+  ElfFileReader reader(fd, arch);
+  string build_id = reader.read_buildid();
+  if (build_id.empty()) {
+    vector<LibraryPatch> patches;
+    find_library_patches(reader, file_name, arch, patches);
+    return patches;
+  }
+  auto it = cache.find(build_id);
+  if (it != cache.end()) {
+    return it->second;
+  }
+  vector<LibraryPatch>& patches = cache[build_id];
+  find_library_patches(reader, file_name, arch, patches);
+  LOG(debug) << "Cached " << patches.size() << " library patches for "
+             << file_name << " (build-id " << build_id << ")";
+  return patches;
+}
+
 static bool file_may_need_instrumentation(const AddressSpace::Mapping& map) {
   size_t file_part = map.map.fsname().rfind('/');
   if (file_part == string::npos) {
@@ -1527,75 +2148,87 @@ static bool file_may_need_instrumentation(const AddressSpace::Mapping& map) {
     fsname.find("ld", file_part) != string::npos;
 }
 
+static ScopedFd open_mapped_file(RecordTask* t, remote_ptr<void> start,
+                                 size_t size, int child_fd) {
+  if (child_fd >= 0) {
+    ScopedFd open_fd = t->open_fd(child_fd, O_RDONLY);
+    ASSERT(t, open_fd.is_open()) << "Failed to open child fd " << child_fd;
+    return open_fd;
+  }
+  char buf[100];
+  sprintf(buf, "/proc/%d/map_files/%llx-%llx", t->tid,
+          (long long)start.as_int(), (long long)start.as_int() + size);
+  // Reading these directly requires CAP_SYS_ADMIN, so open the link target
+  // instead.
+  char link[PATH_MAX];
+  int ret = readlink(buf, link, sizeof(link) - 1);
+  if (ret < 0) {
+    return ScopedFd();
+  }
+  link[ret] = 0;
+  return ScopedFd(link, O_RDONLY);
+}
+
 void Monkeypatcher::patch_after_mmap(RecordTask* t, remote_ptr<void> start,
                                      size_t size, size_t offset_bytes,
                                      int child_fd, MmapMode mode) {
   const auto& map = t->vm()->mapping_of(start);
-  if (file_may_need_instrumentation(map) &&
-      (t->arch() == x86 || t->arch() == x86_64)) {
-    ScopedFd open_fd;
-    if (child_fd >= 0) {
-      open_fd = t->open_fd(child_fd, O_RDONLY);
-      ASSERT(t, open_fd.is_open()) << "Failed to open child fd " << child_fd;
-    } else {
-      char buf[100];
-      sprintf(buf, "/proc/%d/map_files/%llx-%llx", t->tid,
-              (long long)start.as_int(), (long long)start.as_int() + size);
-      // Reading these directly requires CAP_SYS_ADMIN, so open the link target
-      // instead.
-      char link[PATH_MAX];
-      int ret = readlink(buf, link, sizeof(link) - 1);
-      if (ret < 0) {
-        return;
-      }
-      link[ret] = 0;
-      open_fd = ScopedFd(link, O_RDONLY);
-      if (!open_fd.is_open()) {
-        return;
-      }
-    }
-    ElfFileReader reader(open_fd, t->arch());
-    // Check for symbols first in the library itself, regardless of whether
-    // there is a debuglink.  For example, on Fedora 26, the .symtab and
-    // .strtab sections are stripped from the debuginfo file for
-    // libpthread.so.
-    SymbolTable syms = reader.read_symbols(".symtab", ".strtab");
-    if (syms.size() == 0) {
-      ScopedFd debug_fd = reader.open_debug_file(map.map.fsname());
-      if (debug_fd.is_open()) {
-        ElfFileReader debug_reader(debug_fd, t->arch());
-        syms = debug_reader.read_symbols(".symtab", ".strtab");
-      }
+  PatchSiteCache* cache = t->session().patch_site_cache();
+  bool want_cached_sites = cache && is_x86ish(t->arch()) &&
+                           (map.map.prot() & PROT_EXEC) &&
+                           map.map.inode() != KernelMapping::NO_INODE;
+  bool want_library_patches = file_may_need_instrumentation(map) &&
+                              (t->arch() == x86 || t->arch() == x86_64);
+  if (!want_cached_sites && !want_library_patches) {
+    return;
+  }
+  ScopedFd open_fd = open_mapped_file(t, start, size, child_fd);
+  if (!open_fd.is_open()) {
+    return;
+  }
+  if (want_cached_sites) {
+    string build_id = cache->note_mapped_file(map.map, open_fd);
+    if (!build_id.empty() && !cache->sites(build_id, t->arch()).empty()) {
+      pending_cached_site_ranges.push_back(MemoryRange(start, size));
     }
-    for (size_t i = 0; i < syms.size(); ++i) {
-      if (syms.is_name(i, "__elision_aconf")) {
-        static const int zero = 0;
-        // Setting __elision_aconf.retry_try_xbegin to zero means that
-        // pthread rwlocks don't try to use elision at all. See ELIDE_LOCK
-        // in glibc's elide.h.
-        set_and_record_bytes(t, reader, syms.addr(i) + 8, &zero, sizeof(zero),
-                             start, size, offset_bytes);
-      }
-      if (syms.is_name(i, "elision_init")) {
-        // Make elision_init return without doing anything. This means
-        // the __elision_available and __pthread_force_elision flags will
-        // remain zero, disabling elision for mutexes. See glibc's
-        // elision-conf.c.
-        static const uint8_t ret = 0xC3;
-        set_and_record_bytes(t, reader, syms.addr(i), &ret, sizeof(ret), start,
-                             size, offset_bytes);
+  }
+  if (want_library_patches) {
+    vector<LibraryPatch> patches =
+        library_patches(open_fd, t->arch(), map.map.fsname());
+    for (const auto& patch : patches) {
+      remote_ptr<void> addr =
+          resolve_address(patch.file_offset, start, size, offset_bytes);
+      if (!addr) {
+        continue;
       }
-      // The following operations can only be applied once because after the
-      // patch is applied the code no longer matches the expected template.
-      // For replaying a replay to work, we need to only apply these changes
-      // during a real exec, not during the mmap operations performed when rr
-      // replays an exec.
-      if (mode == MMAP_EXEC &&
-          (syms.is_name(i, "_dl_runtime_resolve_fxsave") ||
-           syms.is_name(i, "_dl_runtime_resolve_xsave") ||
-           syms.is_name(i, "_dl_runtime_resolve_xsavec"))) {
-        patch_dl_runtime_resolve(*this, t, reader, syms.addr(i), start, size,
-                                 offset_bytes);
+      switch (patch.type) {
+        case LibraryPatch::ELISION_ACONF: {
+          static const int zero = 0;
+          // Setting __elision_aconf.retry_try_xbegin to zero means that
+          // pthread rwlocks don't try to use elision at all. See ELIDE_LOCK
+          // in glibc's elide.h.
+          set_and_record_bytes(t, addr, &zero, sizeof(zero));
+          break;
+        }
+        case LibraryPatch::ELISION_INIT: {
+          // Make elision_init return without doing anything. This means
+          // the __elision_available and __pthread_force_elision flags will
+          // remain zero, disabling elision for mutexes. See glibc's
+          // elision-conf.c.
+          static const uint8_t ret = 0xC3;
+          set_and_record_bytes(t, addr, &ret, sizeof(ret));
+          break;
+        }
+        case LibraryPatch::DL_RUNTIME_RESOLVE:
+          // This can only be applied once because after the patch is applied
+          // the code no longer matches the expected template.
+          // For replaying a replay to work, we need to only apply this change
+          // during a real exec, not during the mmap operations performed when
+          // rr replays an exec.
+          if (mode == MMAP_EXEC) {
+            patch_dl_runtime_resolve(*this, t, addr);
+          }
+          break;
       }
     }
   }
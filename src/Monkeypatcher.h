@@ -7,6 +7,7 @@
 #include <unordered_set>
 #include <vector>
 
+#include "MemoryRange.h"
 #include "preload/preload_interface.h"
 
 #include "remote_code_ptr.h"
@@ -116,6 +117,15 @@ public:
   void patch_after_mmap(RecordTask* t, remote_ptr<void> start, size_t size,
                         size_t offset_bytes, int child_fd, MmapMode mode);
 
+  /**
+   * Patch the syscall instructions that the session's PatchSiteCache knows
+   * about in executable mappings that appeared since the last call, once the
+   * syscall hooks are available. |t| must have just exited a syscall.
+   * Returns true if anything was patched, in which case the caller must
+   * record a PATCH_SYSCALL event with patch_after_syscall set.
+   */
+  bool apply_cached_patch_sites(RecordTask* t);
+
   /**
    * The list of pages we've allocated to hold our extended jumps.
    */
@@ -147,12 +157,24 @@ public:
 
 private:
   /**
-   * `ip` is the address of the instruction that triggered the syscall or trap
+   * `ip` is the address of the instruction that triggered the syscall or trap.
+   * If no hook matches and `relocate_length` is non-null, try to find a way
+   * to patch the syscall by relocating the instructions after it instead
+   * (x86-64 only). On success, the number of bytes to relocate is returned
+   * in `relocate_length`, along with the hook to use.
    */
   const syscall_patch_hook* find_syscall_hook(RecordTask* t,
                                               remote_code_ptr ip,
                                               bool entering_syscall,
-                                              size_t instruction_length);
+                                              size_t instruction_length,
+                                              size_t* relocate_length = nullptr);
+
+  bool try_patch_cached_site(RecordTask* t, remote_code_ptr ip);
+  /**
+   * Add the syscall instruction at |ip|, which we just patched, to the
+   * session's PatchSiteCache.
+   */
+  void note_patched_site(RecordTask* t, remote_code_ptr ip);
 
   /**
    * The list of supported syscall patches obtained from the preload
@@ -165,6 +187,12 @@ private:
    * instructions that we've tried (or are currently trying) to patch.
    */
   std::unordered_set<remote_code_ptr> tried_to_patch_syscall_addresses;
+
+  /**
+   * Executable file mappings with cached patch sites that
+   * apply_cached_patch_sites hasn't processed yet.
+   */
+  std::vector<MemoryRange> pending_cached_site_ranges;
 };
 
 } // namespace rr
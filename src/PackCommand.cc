@@ -19,6 +19,7 @@
 #include "GdbServer.h"
 #include "ReplaySession.h"
 #include "ScopedFd.h"
+#include "TraceFrameIndex.h"
 #include "TraceStream.h"
 #include "kernel_metadata.h"
 #include "log.h"
@@ -436,6 +437,12 @@ static void rewrite_mmaps(const map<string, string>& file_map,
   // "rr pack" that runs to completion will clean them all up.
   // AFTER this point, we have altered the mmaps file and the trace remains
   // valid.
+  // A frame index records offsets into the old mmaps file, so it must be
+  // gone before the switchover; pack() rebuilds it afterwards.
+  string index_path = TraceFrameIndex::path(trace_dir);
+  if (unlink(index_path.c_str()) < 0 && errno != ENOENT) {
+    FATAL() << "Can't delete file " << index_path;
+  }
   string mmaps_path = trace_dir + "/mmaps";
   if (rename(path.c_str(), mmaps_path.c_str()) < 0) {
     FATAL() << "Error renaming " << path << " to " << mmaps_path;
@@ -490,6 +497,8 @@ static int pack(const string& trace_dir, const PackFlags& flags) {
     FATAL() << "realpath failed on " << dir;
   }
   string abspath(buf);
+  bool had_index =
+      access(TraceFrameIndex::path(abspath).c_str(), F_OK) == 0;
 
   if (flags.symlink) {
     map<string, string> canonical_symlink_map =
@@ -503,6 +512,11 @@ static int pack(const string& trace_dir, const PackFlags& flags) {
     delete_unnecessary_files(canonical_mmapped_files, abspath);
   }
 
+  if (had_index && !TraceFrameIndex::build(abspath)) {
+    fprintf(stderr, "rr: Failed to rebuild frame index for `%s'.\n",
+            dir.c_str());
+  }
+
   if (!probably_not_interactive(STDOUT_FILENO)) {
     printf("rr: Packed trace directory `%s'.\n", dir.c_str());
   }
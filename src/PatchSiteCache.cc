@@ -0,0 +1,139 @@
+/* -*- Mode: C++; tab-width: 8; c-basic-offset: 2; indent-tabs-mode: nil; -*- */
+
+#include "PatchSiteCache.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "AddressSpace.h"
+#include "ElfReader.h"
+#include "ScopedFd.h"
+#include "kernel_metadata.h"
+#include "log.h"
+#include "util.h"
+
+using namespace std;
+
+namespace rr {
+
+static const char PATCH_SITE_CACHE_MAGIC[] = "rrpatchsites1\n";
+
+unique_ptr<PatchSiteCache> PatchSiteCache::create() {
+  string dir = rr_cache_dir("patch-sites");
+  if (dir.empty()) {
+    return nullptr;
+  }
+  return unique_ptr<PatchSiteCache>(new PatchSiteCache(dir));
+}
+
+string PatchSiteCache::note_mapped_file(const KernelMapping& km,
+                                        ScopedFd& fd) {
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    return string();
+  }
+  auto key = make_pair(km.device(), km.inode());
+  auto it = mapped_files.find(key);
+  if (it != mapped_files.end() && it->second.size == st.st_size &&
+      it->second.mtime.tv_sec == st.st_mtim.tv_sec &&
+      it->second.mtime.tv_nsec == st.st_mtim.tv_nsec) {
+    return it->second.build_id;
+  }
+  // The file is new to us, or was replaced in place since we last saw it.
+  MappedFile& file = mapped_files[key];
+  file.size = st.st_size;
+  file.mtime = st.st_mtim;
+  ElfFileReader reader(fd);
+  file.build_id = reader.read_buildid();
+  return file.build_id;
+}
+
+string PatchSiteCache::build_id(const KernelMapping& km) const {
+  auto it = mapped_files.find(make_pair(km.device(), km.inode()));
+  if (it == mapped_files.end()) {
+    return string();
+  }
+  return it->second.build_id;
+}
+
+string PatchSiteCache::path(const Key& key) const {
+  return dir + "/" + key.first + "-" + arch_name(key.second);
+}
+
+static void read_sites(const string& path, set<uint64_t>* sites) {
+  FILE* f = fopen(path.c_str(), "r");
+  if (!f) {
+    return;
+  }
+  char magic[sizeof(PATCH_SITE_CACHE_MAGIC)];
+  if (fgets(magic, sizeof(magic), f) &&
+      !strcmp(magic, PATCH_SITE_CACHE_MAGIC)) {
+    uint64_t offset;
+    while (fscanf(f, "%" SCNx64 "\n", &offset) == 1) {
+      sites->insert(offset);
+    }
+  } else {
+    LOG(warn) << "Ignoring invalid patch site cache file " << path;
+  }
+  fclose(f);
+}
+
+PatchSiteCache::Entry& PatchSiteCache::entry(const Key& key) {
+  auto it = entries.find(key);
+  if (it != entries.end()) {
+    return it->second;
+  }
+  Entry& e = entries[key];
+  read_sites(path(key), &e.sites);
+  LOG(debug) << "Loaded " << e.sites.size() << " cached patch sites for "
+             << key.first;
+  return e;
+}
+
+const set<uint64_t>& PatchSiteCache::sites(const string& build_id,
+                                           SupportedArch arch) {
+  return entry(make_pair(build_id, arch)).sites;
+}
+
+void PatchSiteCache::add_site(const string& build_id, SupportedArch arch,
+                              uint64_t file_offset) {
+  Entry& e = entry(make_pair(build_id, arch));
+  if (e.sites.insert(file_offset).second) {
+    e.dirty = true;
+  }
+}
+
+void PatchSiteCache::save() {
+  for (auto& it : entries) {
+    Entry& e = it.second;
+    if (!e.dirty) {
+      continue;
+    }
+    string file_path = path(it.first);
+    // Another recording may have added sites since we loaded this entry.
+    read_sites(file_path, &e.sites);
+    string tmp_path = file_path + ".tmp" + to_string(getpid());
+    FILE* f = fopen(tmp_path.c_str(), "w");
+    if (!f) {
+      LOG(warn) << "Can't write patch site cache " << tmp_path;
+      continue;
+    }
+    fputs(PATCH_SITE_CACHE_MAGIC, f);
+    for (uint64_t offset : e.sites) {
+      fprintf(f, "%" PRIx64 "\n", offset);
+    }
+    bool ok = !ferror(f);
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp_path.c_str(), file_path.c_str()) < 0) {
+      LOG(warn) << "Can't write patch site cache " << file_path;
+      unlink(tmp_path.c_str());
+      continue;
+    }
+    e.dirty = false;
+  }
+}
+
+} // namespace rr
@@ -0,0 +1,104 @@
+/* -*- Mode: C++; tab-width: 8; c-basic-offset: 2; indent-tabs-mode: nil; -*- */
+
+#ifndef RR_PATCH_SITE_CACHE_H_
+#define RR_PATCH_SITE_CACHE_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "kernel_abi.h"
+
+namespace rr {
+
+class KernelMapping;
+class ScopedFd;
+
+/**
+ * A cache, shared by all recordings that use `rr record --patch-cache`, of
+ * the syscall instructions Monkeypatcher has successfully patched in each
+ * binary. Binaries are identified by build-id and sites by file offset, so
+ * entries stay valid across processes regardless of where the binary is
+ * loaded. Monkeypatcher uses it to patch known sites as soon as the
+ * syscall hooks are available in a new process, instead of waiting for each
+ * site to trap into rr first.
+ *
+ * Cached sites are only hints. Monkeypatcher revalidates every site against
+ * the tracee's code before patching it, so a stale or corrupt cache can cost
+ * time but not correctness.
+ *
+ * The cache lives in $XDG_CACHE_HOME/rr/patch-sites, one file per build-id
+ * and architecture.
+ */
+class PatchSiteCache {
+public:
+  /**
+   * Returns null if there's no usable cache directory.
+   */
+  static std::unique_ptr<PatchSiteCache> create();
+
+  /**
+   * Note that |km| maps the file open in |fd|. Returns the file's build-id,
+   * or an empty string if it doesn't have one.
+   */
+  std::string note_mapped_file(const KernelMapping& km, ScopedFd& fd);
+  /**
+   * The build-id of the file mapped by |km|, if an earlier note_mapped_file
+   * call saw it. Empty otherwise.
+   */
+  std::string build_id(const KernelMapping& km) const;
+
+  /**
+   * File offsets of the patched syscall instructions recorded for the
+   * binary. Loaded from disk on first use.
+   */
+  const std::set<uint64_t>& sites(const std::string& build_id,
+                                  SupportedArch arch);
+  void add_site(const std::string& build_id, SupportedArch arch,
+                uint64_t file_offset);
+
+  /**
+   * Write out every binary that gained sites, merging with whatever other
+   * recordings wrote in the meantime.
+   */
+  void save();
+
+private:
+  explicit PatchSiteCache(const std::string& dir) : dir(dir) {}
+
+  typedef std::pair<std::string, SupportedArch> Key;
+  struct KeyHash {
+    size_t operator()(const Key& key) const {
+      return std::hash<std::string>()(key.first) ^ key.second;
+    }
+  };
+  struct Entry {
+    Entry() : dirty(false) {}
+    std::set<uint64_t> sites;
+    bool dirty;
+  };
+  struct MappedFile {
+    off_t size;
+    struct timespec mtime;
+    std::string build_id;
+  };
+
+  std::string path(const Key& key) const;
+  Entry& entry(const Key& key);
+
+  std::string dir;
+  std::unordered_map<Key, Entry, KeyHash> entries;
+  // Indexed by the device and inode the kernel reports for the mapping.
+  std::map<std::pair<dev_t, ino_t>, MappedFile> mapped_files;
+};
+
+} // namespace rr
+
+#endif /* RR_PATCH_SITE_CACHE_H_ */
@@ -100,7 +100,24 @@ RecordCommand RecordCommand::singleton(
     "  --asan                     Override heuristics and always enable ASAN\n"
     "                             compatibility.\n"
     "  --tsan                     Override heuristics and always enable TSAN\n"
-    "                             compatibility.\n");
+    "                             compatibility.\n"
+    "  --profile=<FILE>           Write a breakdown of where rr spent its time\n"
+    "                             per event type and syscall to FILE.\n"
+    "  --monitor-shared-memory=<PATTERN>\n"
+    "                             Read-only MAP_SHARED mappings of files whose\n"
+    "                             path matches the glob <PATTERN> are written\n"
+    "                             by processes outside the recording; record\n"
+    "                             changes to them. There can be any number of\n"
+    "                             these.\n"
+    "  --patch-cache              Remember which syscall instructions were\n"
+    "                             patched in each binary, in\n"
+    "                             $XDG_CACHE_HOME/rr/patch-sites, and patch\n"
+    "                             them up front in later recordings.\n"
+    "  --patch-relocate           Also patch syscalls followed by instructions\n"
+    "                             that no syscall hook recognizes, by moving\n"
+    "                             those instructions into the patch stub.\n"
+    "                             Unsafe if other code jumps into the moved\n"
+    "                             instructions with a near (rel32) branch.\n");
 
 struct RecordFlags {
   vector<string> extra_env;
@@ -180,6 +197,18 @@ struct RecordFlags {
   /* True if we should always enable TSAN compatibility. */
   bool tsan;
 
+  /* If nonempty, write a RecordProfiler report here. */
+  string profile_file;
+
+  /* Extra file path globs for MonitoredSharedMemory. */
+  vector<string> monitored_shared_memory_patterns;
+
+  /* True if we should use and update the PatchSiteCache. */
+  bool patch_cache;
+
+  /* True if Monkeypatcher may relocate instructions after syscalls. */
+  bool patch_relocate;
+
   RecordFlags()
       : max_ticks(Scheduler::DEFAULT_MAX_TICKS),
         ignore_sig(0),
@@ -203,7 +232,9 @@ struct RecordFlags {
         stap_sdt(false),
         unmap_vdso(false),
         asan(false),
-        tsan(false) {}
+        tsan(false),
+        patch_cache(false),
+        patch_relocate(false) {}
 };
 
 static void parse_signal_name(ParsedOption& opt) {
@@ -265,6 +296,10 @@ static bool parse_record_arg(vector<string>& args, RecordFlags& flags) {
     { 16, "disable-avx-512", NO_PARAMETER },
     { 17, "asan", NO_PARAMETER },
     { 18, "tsan", NO_PARAMETER },
+    { 19, "profile", HAS_PARAMETER },
+    { 20, "monitor-shared-memory", HAS_PARAMETER },
+    { 21, "patch-cache", NO_PARAMETER },
+    { 22, "patch-relocate", NO_PARAMETER },
     { 'c', "num-cpu-ticks", HAS_PARAMETER },
     { 'h', "chaos", NO_PARAMETER },
     { 'i', "ignore-signal", HAS_PARAMETER },
@@ -478,6 +513,18 @@ static bool parse_record_arg(vector<string>& args, RecordFlags& flags) {
     case 18:
       flags.tsan = true;
       break;
+    case 19:
+      flags.profile_file = opt.value;
+      break;
+    case 20:
+      flags.monitored_shared_memory_patterns.push_back(opt.value);
+      break;
+    case 21:
+      flags.patch_cache = true;
+      break;
+    case 22:
+      flags.patch_relocate = true;
+      break;
     case 's':
       flags.always_switch = true;
       break;
@@ -582,6 +629,16 @@ static void setup_session_from_flags(RecordSession& session,
   if (flags.syscall_buffer_size > 0) {
     session.set_syscall_buffer_size(flags.syscall_buffer_size);
   }
+  if (!flags.profile_file.empty()) {
+    session.set_profile_file(flags.profile_file);
+  }
+  for (auto& pattern : flags.monitored_shared_memory_patterns) {
+    session.add_monitored_shared_memory_pattern(pattern);
+  }
+  session.set_relocate_patched_instructions(flags.patch_relocate);
+  if (flags.patch_cache && !session.enable_patch_site_cache()) {
+    LOG(warn) << "No usable cache directory; not caching patch sites";
+  }
 
   if (flags.scarce_fds) {
     for (int i = 0; i < 950; ++i) {
@@ -710,6 +767,12 @@ static WaitStatus record(const vector<string>& args, const RecordFlags& flags) {
     }
   } while (step_result.status == RecordSession::STEP_CONTINUE);
 
+  if (session->profiler()) {
+    session->profiler()->write_report();
+  }
+  if (session->patch_site_cache()) {
+    session->patch_site_cache()->save();
+  }
   session->close_trace_writer(TraceWriter::CLOSE_OK);
   static_session = nullptr;
 
@@ -0,0 +1,154 @@
+/* -*- Mode: C++; tab-width: 8; c-basic-offset: 2; indent-tabs-mode: nil; -*- */
+
+#include "RecordProfiler.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "RecordTask.h"
+#include "log.h"
+#include "util.h"
+
+using namespace std;
+
+namespace rr {
+
+static const char* phase_names[RecordProfiler::PHASE_COUNT] = {
+  "schedule", "process", "resume"
+};
+
+RecordProfiler::RecordProfiler(const string& output_file)
+    : output_file(output_file),
+      step_start(0),
+      phase_start(0),
+      step_compression_wait_start(0),
+      first_step_start(0),
+      last_step_end(0) {
+  for (auto& p : step_phase_seconds) {
+    p = 0;
+  }
+}
+
+void RecordProfiler::begin_step(double compression_wait_seconds) {
+  step_start = phase_start = monotonic_now_sec();
+  if (!first_step_start) {
+    first_step_start = step_start;
+  }
+  for (auto& p : step_phase_seconds) {
+    p = 0;
+  }
+  step_compression_wait_start = compression_wait_seconds;
+  step_event = "(none)";
+}
+
+void RecordProfiler::end_phase(Phase phase) {
+  double now = monotonic_now_sec();
+  step_phase_seconds[phase] += now - phase_start;
+  phase_start = now;
+}
+
+void RecordProfiler::set_step_event(RecordTask* t) {
+  const Event& ev = t->ev();
+  if (ev.is_syscall_event()) {
+    step_event = "syscall:" + ev.Syscall().syscall_name();
+  } else {
+    step_event = ev.type_name();
+  }
+}
+
+void RecordProfiler::end_step(double compression_wait_seconds) {
+  end_phase(PHASE_PROCESS);
+  last_step_end = phase_start;
+  double step_seconds = last_step_end - step_start;
+
+  EventStats& s = stats[step_event];
+  ++s.count;
+  for (int i = 0; i < PHASE_COUNT; ++i) {
+    s.phase_seconds[i] += step_phase_seconds[i];
+  }
+  s.max_seconds = max(s.max_seconds, step_seconds);
+  s.compression_wait_seconds +=
+      compression_wait_seconds - step_compression_wait_start;
+  uint64_t us = (uint64_t)(step_seconds * 1000000);
+  int bucket = 0;
+  while (bucket < HISTOGRAM_BUCKETS - 1 && (us >> bucket) > 0) {
+    ++bucket;
+  }
+  ++s.histogram[bucket];
+}
+
+void RecordProfiler::write_report() {
+  FILE* out = fopen(output_file.c_str(), "w");
+  if (!out) {
+    LOG(error) << "Can't open profile output file " << output_file;
+    return;
+  }
+
+  vector<pair<double, const string*>> order;
+  EventStats totals;
+  for (auto& it : stats) {
+    const EventStats& s = it.second;
+    double total = 0;
+    for (int i = 0; i < PHASE_COUNT; ++i) {
+      total += s.phase_seconds[i];
+      totals.phase_seconds[i] += s.phase_seconds[i];
+    }
+    totals.count += s.count;
+    totals.compression_wait_seconds += s.compression_wait_seconds;
+    order.push_back(make_pair(total, &it.first));
+  }
+  sort(order.begin(), order.end(),
+       [](const pair<double, const string*>& a,
+          const pair<double, const string*>& b) {
+         return a.first > b.first;
+       });
+
+  double wall = last_step_end - first_step_start;
+  double in_steps = 0;
+  for (double p : totals.phase_seconds) {
+    in_steps += p;
+  }
+  fprintf(out, "# rr record profile: %llu steps, %.3f s in record_step, "
+               "%.3f s wall clock\n",
+          (unsigned long long)totals.count, in_steps, wall);
+  for (int i = 0; i < PHASE_COUNT; ++i) {
+    fprintf(out, "# %-10s %12.3f ms (%5.1f%%)\n", phase_names[i],
+            totals.phase_seconds[i] * 1000,
+            in_steps > 0 ? 100 * totals.phase_seconds[i] / in_steps : 0.0);
+  }
+  fprintf(out, "# of which waiting for trace compression: %.3f ms\n",
+          totals.compression_wait_seconds * 1000);
+  fprintf(out, "#\n# Histogram buckets are step latencies: <N us:count\n");
+  fprintf(out, "%-32s %10s %12s %10s %10s %12s %12s %12s %12s  %s\n", "event",
+          "count", "total_ms", "mean_us", "max_us", "schedule_ms",
+          "process_ms", "resume_ms", "compress_ms", "histogram");
+  for (auto& o : order) {
+    const EventStats& s = stats[*o.second];
+    fprintf(out, "%-32s %10llu %12.3f %10.1f %10.1f %12.3f %12.3f %12.3f "
+                 "%12.3f ",
+            o.second->c_str(), (unsigned long long)s.count, o.first * 1000,
+            o.first * 1000000 / s.count, s.max_seconds * 1000000,
+            s.phase_seconds[PHASE_SCHEDULE] * 1000,
+            s.phase_seconds[PHASE_PROCESS] * 1000,
+            s.phase_seconds[PHASE_RESUME] * 1000,
+            s.compression_wait_seconds * 1000);
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+      if (!s.histogram[i]) {
+        continue;
+      }
+      if (i == HISTOGRAM_BUCKETS - 1) {
+        fprintf(out, " >=%llu:%llu", 1ULL << (i - 1),
+                (unsigned long long)s.histogram[i]);
+      } else {
+        fprintf(out, " <%llu:%llu", 1ULL << i,
+                (unsigned long long)s.histogram[i]);
+      }
+    }
+    fprintf(out, "\n");
+  }
+  fclose(out);
+}
+
+} // namespace rr
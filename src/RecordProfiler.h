@@ -0,0 +1,82 @@
+/* -*- Mode: C++; tab-width: 8; c-basic-offset: 2; indent-tabs-mode: nil; -*- */
+
+#ifndef RR_RECORD_PROFILER_H_
+#define RR_RECORD_PROFILER_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <unordered_map>
+
+namespace rr {
+
+class RecordTask;
+
+/**
+ * Collects the wall-clock time rr spends in each phase of
+ * RecordSession::record_step, broken down by the kind of event that was
+ * processed (e.g. "syscall:read", "SIGNAL"), for `rr record --profile`.
+ * When recording finishes, write_report() writes per-event counts, times
+ * and latency histograms to the output file.
+ */
+class RecordProfiler {
+public:
+  enum Phase {
+    // Scheduler::reschedule, including blocking until some tracee stops.
+    PHASE_SCHEDULE,
+    // Handling the stop: ptrace events, signals, syscall entry/exit
+    // processing and writing trace data.
+    PHASE_PROCESS,
+    // Signal injection and resuming the tracee.
+    PHASE_RESUME,
+    PHASE_COUNT
+  };
+
+  explicit RecordProfiler(const std::string& output_file);
+
+  // Start timing a record_step.
+  void begin_step(double compression_wait_seconds);
+  // Attribute the time since the previous begin_step/end_phase to `phase`.
+  void end_phase(Phase phase);
+  // Attribute the current step to the event `t` is processing. `t` must be
+  // live; steps whose task disappeared keep the previous attribution.
+  void set_step_event(RecordTask* t);
+  // Finish the step. Any time not yet attributed goes to PHASE_PROCESS.
+  void end_step(double compression_wait_seconds);
+
+  void write_report();
+
+private:
+  enum { HISTOGRAM_BUCKETS = 32 };
+  struct EventStats {
+    EventStats() : count(0), max_seconds(0), compression_wait_seconds(0) {
+      for (auto& p : phase_seconds) {
+        p = 0;
+      }
+      for (auto& h : histogram) {
+        h = 0;
+      }
+    }
+    uint64_t count;
+    double phase_seconds[PHASE_COUNT];
+    double max_seconds;
+    double compression_wait_seconds;
+    // Bucket i counts steps that took less than 2^i microseconds (and at
+    // least 2^(i-1)). The last bucket counts everything longer.
+    uint64_t histogram[HISTOGRAM_BUCKETS];
+  };
+
+  std::string output_file;
+  std::unordered_map<std::string, EventStats> stats;
+  std::string step_event;
+  double step_start;
+  double phase_start;
+  double step_phase_seconds[PHASE_COUNT];
+  double step_compression_wait_start;
+  double first_step_start;
+  double last_step_end;
+};
+
+} // namespace rr
+
+#endif /* RR_RECORD_PROFILER_H_ */
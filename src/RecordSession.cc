@@ -1334,6 +1334,11 @@ void RecordSession::syscall_state_changed(RecordTask* t,
               t->record_event(ev);
             }
           }
+          if (t->vm()->monkeypatcher().apply_cached_patch_sites(t)) {
+            auto ev = Event::patch_syscall();
+            ev.PatchSyscall().patch_after_syscall = true;
+            t->record_event(ev);
+          }
         }
       }
 
@@ -1772,6 +1777,7 @@ bool RecordSession::signal_state_changed(RecordTask* t, StepState* step_state) {
           if (t != ot) {
             if (t->tgid() == ot->tgid() || coredumping_signal_takes_down_entire_vm()) {
               ((RecordTask *)ot)->waiting_for_ptrace_exit = true;
+              scheduler().did_change_task_state((RecordTask *)ot);
             }
           }
         }
@@ -2436,6 +2442,7 @@ RecordSession::RecordSession(const std::string& exe_path,
       use_read_cloning_(true),
       enable_chaos_(false),
       wait_for_all_(false),
+      relocate_patched_instructions_(false),
       use_audit_(use_audit),
       unmap_vdso_(unmap_vdso) {
   if (!has_cpuid_faulting() &&
@@ -2474,8 +2481,42 @@ RecordSession::RecordSession(const std::string& exe_path,
   on_create(t);
 }
 
+namespace {
+/**
+ * Times one record_step for the RecordProfiler, if there is one. The step
+ * is finished whichever way record_step returns.
+ */
+class ProfiledStep {
+public:
+  ProfiledStep(RecordProfiler* profiler, TraceWriter& trace_writer)
+      : profiler(profiler), trace_writer(trace_writer) {
+    if (profiler) {
+      profiler->begin_step(trace_writer.compression_wait_seconds());
+    }
+  }
+  ~ProfiledStep() {
+    if (profiler) {
+      profiler->end_step(trace_writer.compression_wait_seconds());
+    }
+  }
+  void end_phase(RecordProfiler::Phase phase, RecordTask* t = nullptr) {
+    if (profiler) {
+      profiler->end_phase(phase);
+      if (t) {
+        profiler->set_step_event(t);
+      }
+    }
+  }
+
+private:
+  RecordProfiler* profiler;
+  TraceWriter& trace_writer;
+};
+} // anonymous namespace
+
 RecordSession::RecordResult RecordSession::record_step() {
   RecordResult result;
+  ProfiledStep profiled_step(profiler_.get(), trace_writer());
 
   if (task_map.empty()) {
     result.status = STEP_EXITED;
@@ -2503,6 +2544,7 @@ RecordSession::RecordResult RecordSession::record_step() {
     return result;
   }
   RecordTask* t = scheduler().current();
+  profiled_step.end_phase(RecordProfiler::PHASE_SCHEDULE, t);
   if (t->waiting_for_reap) {
     // Give it another chance to be reaped
     t->did_reach_zombie();
@@ -2587,6 +2629,7 @@ RecordSession::RecordResult RecordSession::record_step() {
   }
 
   t->verify_signal_states();
+  profiled_step.end_phase(RecordProfiler::PHASE_PROCESS, t);
 
   // We try to inject a signal if there's one pending; otherwise we continue
   // task execution.
@@ -2603,6 +2646,7 @@ RecordSession::RecordResult RecordSession::record_step() {
 
     task_continue(step_state);
   }
+  profiled_step.end_phase(RecordProfiler::PHASE_RESUME);
 
   return result;
 }
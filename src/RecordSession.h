@@ -3,9 +3,12 @@
 #ifndef RR_RECORD_SESSION_H_
 #define RR_RECORD_SESSION_H_
 
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "PatchSiteCache.h"
+#include "RecordProfiler.h"
 #include "Scheduler.h"
 #include "SeccompFilterRewriter.h"
 #include "Session.h"
@@ -174,6 +177,50 @@ public:
     this->wait_for_all_ = wait_for_all;
   }
 
+  /**
+   * Profile record_step and write a report to `output_file` when
+   * recording finishes.
+   */
+  void set_profile_file(const std::string& output_file) {
+    profiler_ = std::unique_ptr<RecordProfiler>(new RecordProfiler(output_file));
+  }
+  RecordProfiler* profiler() { return profiler_.get(); }
+
+  /**
+   * Files matching one of these fnmatch(3) patterns are assumed to be
+   * written by processes outside the recording when the tracee maps them
+   * read-only and shared. See MonitoredSharedMemory.
+   */
+  void add_monitored_shared_memory_pattern(const std::string& pattern) {
+    monitored_shared_memory_patterns_.push_back(pattern);
+  }
+  const std::vector<std::string>& monitored_shared_memory_patterns() const {
+    return monitored_shared_memory_patterns_;
+  }
+
+  /**
+   * Share patched syscall sites with other recordings through a
+   * PatchSiteCache. Returns false if there's no usable cache directory.
+   */
+  bool enable_patch_site_cache() {
+    patch_site_cache_ = PatchSiteCache::create();
+    return patch_site_cache_ != nullptr;
+  }
+  PatchSiteCache* patch_site_cache() { return patch_site_cache_.get(); }
+
+  /**
+   * When true, Monkeypatcher may patch a syscall followed by instructions no
+   * hook recognizes by moving those instructions into the patch stub. Only
+   * short branches into the moved instructions are detected, so this is off
+   * by default.
+   */
+  void set_relocate_patched_instructions(bool relocate) {
+    relocate_patched_instructions_ = relocate;
+  }
+  bool relocate_patched_instructions() const {
+    return relocate_patched_instructions_;
+  }
+
   virtual Task* new_task(pid_t tid, pid_t rec_tid, uint32_t serial,
                          SupportedArch a, const std::string& name) override;
 
@@ -266,6 +313,7 @@ private:
    * When true, wait for all tracees to exit before finishing recording.
    */
   bool wait_for_all_;
+  bool relocate_patched_instructions_;
 
   std::vector<MemoryRange> excluded_ranges_;
   MemoryRange fixed_global_exclusion_range_;
@@ -278,6 +326,12 @@ private:
 
   bool use_audit_;
   bool unmap_vdso_;
+
+  std::unique_ptr<RecordProfiler> profiler_;
+
+  std::vector<std::string> monitored_shared_memory_patterns_;
+
+  std::unique_ptr<PatchSiteCache> patch_site_cache_;
 };
 
 } // namespace rr
@@ -722,6 +722,9 @@ vector<remote_code_ptr> RecordTask::syscallbuf_syscall_entry_breakpoints() {
 }
 
 void RecordTask::did_wait() {
+  // Whoever collected this status, the scheduler must look at us again.
+  session().scheduler().did_change_task_state(this);
+
   for (auto p : syscallbuf_syscall_entry_breakpoints()) {
     vm()->remove_breakpoint(p, BKPT_INTERNAL);
   }
@@ -842,6 +845,7 @@ void RecordTask::did_reach_zombie() {
       reap();
     } else {
       waiting_for_reap = true;
+      session().scheduler().did_change_task_state(this);
     }
   }
   if ((already_reaped() || !waiting_for_reap) && !emulated_stop_pending) {
@@ -917,6 +921,7 @@ void RecordTask::send_synthetic_SIGCHLD_if_necessary() {
     ret = syscall(SYS_rt_tgsigqueueinfo, wake_task->tgid(), wake_task->tid,
                   SIGCHLD, &si);
     ASSERT(this, ret == 0);
+    session().scheduler().did_change_task_state(wake_task);
     if (wake_task->is_sig_blocked(SIGCHLD)) {
       LOG(debug) << "SIGCHLD is blocked, kicking it out of the syscall";
       // Just sending SIGCHLD won't wake it up. Send it a TIME_SLICE_SIGNAL
@@ -74,7 +74,13 @@ ReplayCommand ReplayCommand::singleton(
     "  --serve-files              Serve all files from the trace rather than\n"
     "                             assuming they exist on disk. Debugging will\n"
     "                             be slower, but be able to tolerate missing files\n"
-    "  --tty <file>               Redirect tracee replay output to <file>\n");
+    "  --tty <file>               Redirect tracee replay output to <file>\n"
+    "  --checkpoint-memory-budget=<MB>\n"
+    "                             evict reverse-execution checkpoints to keep\n"
+    "                             the memory they hold below <MB> megabytes\n"
+    "  --fast                     skip rr's consistency checks (register,\n"
+    "                             tick and memory validation). Divergence\n"
+    "                             from the recording may go unnoticed.\n");
 
 struct ReplayFlags {
   // Start a debug server for the task scheduled at the first
@@ -135,6 +141,13 @@ struct ReplayFlags {
 
   string tty;
 
+  // When nonzero, limit memory held by reverse-exec checkpoints to this
+  // many bytes.
+  uint64_t checkpoint_memory_budget;
+
+  // When true, skip replay consistency checks.
+  bool fast_replay;
+
   ReplayFlags()
       : goto_event(0),
         singlestep_to_event(0),
@@ -149,7 +162,9 @@ struct ReplayFlags {
         cpu_unbound(false),
         share_private_mappings(false),
         dump_interval(0),
-        serve_files(false) {}
+        serve_files(false),
+        checkpoint_memory_budget(0),
+        fast_replay(false) {}
 };
 
 static bool parse_replay_arg(vector<string>& args, ReplayFlags& flags) {
@@ -176,6 +191,8 @@ static bool parse_replay_arg(vector<string>& args, ReplayFlags& flags) {
     { 2, "stats", HAS_PARAMETER },
     { 3, "serve-files", NO_PARAMETER },
     { 4, "tty", HAS_PARAMETER },
+    { 5, "checkpoint-memory-budget", HAS_PARAMETER },
+    { 6, "fast", NO_PARAMETER },
     { 'u', "cpu-unbound", NO_PARAMETER },
     { 'i', "interpreter", HAS_PARAMETER }
   };
@@ -267,6 +284,15 @@ static bool parse_replay_arg(vector<string>& args, ReplayFlags& flags) {
     case 4:
       flags.tty = opt.value;
       break;
+    case 5:
+      if (!opt.verify_valid_int(1, INT32_MAX)) {
+        return false;
+      }
+      flags.checkpoint_memory_budget = (uint64_t)opt.int_value * 1024 * 1024;
+      break;
+    case 6:
+      flags.fast_replay = true;
+      break;
     case 'u':
       flags.cpu_unbound = true;
       break;
@@ -344,6 +370,7 @@ static ReplaySession::Flags session_flags(const ReplayFlags& flags) {
   result.redirect_stdio_file = flags.tty;
   result.share_private_mappings = flags.share_private_mappings;
   result.cpu_unbound = flags.cpu_unbound;
+  result.fast_replay = flags.fast_replay;
   return result;
 }
 
@@ -472,7 +499,10 @@ static int replay(const string& trace_dir, const ReplayFlags& flags) {
       conn_flags.debugger_name = flags.gdb_binary_file_path;
       conn_flags.keep_listening = flags.keep_listening;
       conn_flags.serve_files = flags.serve_files;
-      GdbServer(session, target).serve_replay(conn_flags);
+      GdbServer server(session, target);
+      server.get_timeline().set_checkpoint_memory_budget(
+          flags.checkpoint_memory_budget);
+      server.serve_replay(conn_flags);
     }
 
     // Everything should have been cleaned up by now.
@@ -505,6 +535,8 @@ static int replay(const string& trace_dir, const ReplayFlags& flags) {
         target.pid = session->trace_reader().peek_frame().tid();
       }
       GdbServer server(session, target);
+      server.get_timeline().set_checkpoint_memory_budget(
+          flags.checkpoint_memory_budget);
 
       server_ptr = &server;
       struct sigaction sa;
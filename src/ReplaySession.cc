@@ -1172,7 +1172,7 @@ Completion ReplaySession::emulate_signal_delivery(ReplayTask* oldtask,
 }
 
 void ReplaySession::check_ticks_consistency(ReplayTask* t, const Event& ev) {
-  if (!done_initial_exec()) {
+  if (!done_initial_exec() || !validate_replay()) {
     return;
   }
 
@@ -1347,24 +1347,56 @@ static void maybe_handle_rseq(ReplayTask* t) {
   RR_ARCH_FUNCTION(maybe_handle_rseq_arch, t->arch(), t);
 }
 
+/**
+ * Count the buffered syscall records in [from, to) with a single read of
+ * the tracee's syscallbuf, rather than one read per record.
+ */
+static size_t count_syscallbuf_records(
+    ReplayTask* t, remote_ptr<const struct syscallbuf_record> from,
+    remote_ptr<const struct syscallbuf_record> to) {
+  if (from >= to) {
+    return 0;
+  }
+  vector<uint8_t> records =
+      t->read_mem(from.cast<uint8_t>(), to.as_int() - from.as_int());
+  size_t count = 0;
+  size_t offset = 0;
+  while (offset + sizeof(struct syscallbuf_record) <= records.size()) {
+    auto rec =
+        reinterpret_cast<const struct syscallbuf_record*>(records.data() + offset);
+    ++count;
+    offset += stored_record_size(rec->size);
+  }
+  return count;
+}
+
 /**
  * Replay all the syscalls recorded in the interval between |t|'s
  * current execution point and the next non-syscallbuf event (the one
  * that flushed the buffer).  Return COMPLETE if successful or INCOMPLETE if an
  * unhandled interrupt occurred.
+ *
+ * The tracee runs through all the buffered records in one resume, stopping
+ * only at the breakpoint after the last record. Records that need replay
+ * assistance trap individually; those are handled here with the breakpoint
+ * left armed so that each costs a single extra stop.
  */
 Completion ReplaySession::flush_syscallbuf(ReplayTask* t,
                                            const StepConstraints& constraints) {
   bool legacy_breakpoint_mode = t->vm()->legacy_breakpoint_mode();
   bool user_breakpoint_at_addr = false;
   remote_code_ptr remote_brkpt_addr;
+  bool breakpoint_value_armed = false;
+  auto next_rec = t->next_syscallbuf_record();
   while (true) {
-    auto next_rec = t->next_syscallbuf_record();
     uint32_t skip_mprotect_records = t->read_mem(
         REMOTE_PTR_FIELD(t->syscallbuf_child, mprotect_record_count_completed));
 
     TicksRequest ticks_request;
     if (!compute_ticks_request(t, constraints, &ticks_request)) {
+      if (breakpoint_value_armed) {
+        write_breakpoint_value(t, (uint64_t)-1);
+      }
       return INCOMPLETE;
     }
 
@@ -1376,10 +1408,11 @@ Completion ReplaySession::flush_syscallbuf(ReplayTask* t,
             t->vm()->stopping_breakpoint_table_entry_size();
       bool added = t->vm()->add_breakpoint(remote_brkpt_addr, BKPT_INTERNAL);
       ASSERT(t, added);
-    } else {
+    } else if (!breakpoint_value_armed) {
       LOG(debug) << "Adding breakpoint";
       write_breakpoint_value(t,
         (uint64_t)current_step.flush.stop_breakpoint_offset);
+      breakpoint_value_armed = true;
     }
 
     auto complete =
@@ -1390,28 +1423,31 @@ Completion ReplaySession::flush_syscallbuf(ReplayTask* t,
           t->vm()->get_breakpoint_type_at_addr(remote_brkpt_addr) != BKPT_INTERNAL;
       t->vm()->remove_breakpoint(remote_brkpt_addr,
                                  BKPT_INTERNAL);
-    } else {
-      LOG(debug) << "Removing breakpoint " << t->status();
-      write_breakpoint_value(t, (uint64_t)-1);
     }
 
     // Account for buffered syscalls just completed
     auto end_rec = t->next_syscallbuf_record();
-    while (next_rec != end_rec) {
+    size_t completed = count_syscallbuf_records(t, next_rec, end_rec);
+    for (size_t i = 0; i < completed; ++i) {
       accumulate_syscall_performed();
-      next_rec = next_rec.as_int() + t->stored_record_size(next_rec);
     }
+    next_rec = end_rec;
 
     // Apply the mprotect records we just completed.
     apply_mprotect_records(t, skip_mprotect_records);
 
-    if (complete == INCOMPLETE && t->stop_sig() == SIGTRAP) {
-      do_replay_assist(t);
+    if (complete == INCOMPLETE && t->stop_sig() == SIGTRAP &&
+        do_replay_assist(t)) {
+      // The breakpoint value stays armed; just resume to the next stop.
+      continue;
     }
 
     if (t->stop_sig() == PerfCounters::TIME_SLICE_SIGNAL) {
       // This would normally be triggered by constraints.ticks_target but it's
       // also possible to get stray signals here.
+      if (breakpoint_value_armed) {
+        write_breakpoint_value(t, (uint64_t)-1);
+      }
       return INCOMPLETE;
     }
 
@@ -1420,6 +1456,11 @@ Completion ReplaySession::flush_syscallbuf(ReplayTask* t,
     }
   }
 
+  if (breakpoint_value_armed) {
+    LOG(debug) << "Removing breakpoint " << t->status();
+    write_breakpoint_value(t, (uint64_t)-1);
+  }
+
   if (legacy_breakpoint_mode) {
     ASSERT(t, t->stop_sig() == SIGTRAP)
         << "Replay got unexpected signal (or none) " << t->stop_sig();
@@ -2005,16 +2046,18 @@ ReplayResult ReplaySession::replay_step(const StepConstraints& constraints) {
 
   if (t) {
     const Event& ev = trace_frame.event();
-    if (done_initial_exec() && ev.is_syscall_event() &&
-        rr::Flags::get().check_cached_mmaps) {
-      t->vm()->verify(t);
-    }
+    if (validate_replay()) {
+      if (done_initial_exec() && ev.is_syscall_event() &&
+          rr::Flags::get().check_cached_mmaps) {
+        t->vm()->verify(t);
+      }
 
-    if (has_deterministic_ticks(ev, current_step)) {
-      check_ticks_consistency(t, ev);
-    }
+      if (has_deterministic_ticks(ev, current_step)) {
+        check_ticks_consistency(t, ev);
+      }
 
-    debug_memory(t);
+      debug_memory(t);
+    }
 
     check_for_watchpoint_changes(t, result.break_status);
     check_approaching_ticks_target(t, constraints, result.break_status);
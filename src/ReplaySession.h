@@ -241,13 +241,17 @@ public:
       : redirect_stdio(false)
       , share_private_mappings(false)
       , replay_stops_at_first_execve(false)
-      , cpu_unbound(false) {}
+      , cpu_unbound(false)
+      , fast_replay(false) {}
     Flags(const Flags&) = default;
     bool redirect_stdio;
     std::string redirect_stdio_file;
     bool share_private_mappings;
     bool replay_stops_at_first_execve;
     bool cpu_unbound;
+    // Skip checks that only detect divergence or rr bugs (register and
+    // tick validation, mapping verification, memory checksums/dumps).
+    bool fast_replay;
   };
 
   /**
@@ -304,6 +308,12 @@ public:
 
   const Flags& flags() const { return flags_; }
 
+  /**
+   * True if we should verify that replay matches the recording at each
+   * event.
+   */
+  bool validate_replay() const { return !flags_.fast_replay; }
+
   typedef std::set<MemoryRange, MappingComparator> MemoryRanges;
   /**
    * Returns an ordered set of MemoryRanges representing the address space
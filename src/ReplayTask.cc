@@ -105,7 +105,7 @@ void ReplayTask::did_prctl_set_prname(remote_ptr<void> child_addr) {
 void ReplayTask::validate_regs(uint32_t flags) {
   /* don't validate anything before execve is done as the actual
    * process did not start prior to this point */
-  if (!session().done_initial_exec()) {
+  if (!session().done_initial_exec() || !session().validate_replay()) {
     return;
   }
   if (seen_sched_in_syscallbuf_syscall_hook) {
@@ -80,7 +80,8 @@ bool ReplayTimeline::less_than(const Mark& m1, const Mark& m2) {
 ReplayTimeline::ReplayTimeline(std::shared_ptr<ReplaySession> session)
     : current(std::move(session)),
       breakpoints_applied(false),
-      reverse_execution_barrier_event_(0) {
+      reverse_execution_barrier_event_(0),
+      checkpoint_memory_budget(0) {
   current->set_visible_execution(false);
 }
 
@@ -346,6 +347,7 @@ void ReplayTimeline::seek_to_before_key(const MarkKey& key) {
       for (const auto& mark_it : marks[it->first]) {
         if (mark_it->checkpoint) {
           current = mark_it->checkpoint->clone();
+          ++mark_it->checkpoint_restores;
           // At this point, mark_it->checkpoint is fully initialized but current
           // is not. Swap them so that mark_it->checkpoint is not fully
           // initialized, to reduce resource usage.
@@ -380,6 +382,7 @@ void ReplayTimeline::seek_up_to_mark(const Mark& mark) {
     }
     if (at_or_before_mark && m->checkpoint) {
       current = m->checkpoint->clone();
+      ++m->checkpoint_restores;
       // At this point, m->checkpoint is fully initialized but current
       // is not. Swap them so that m->checkpoint is not fully
       // initialized, to reduce resource usage.
@@ -1577,7 +1580,7 @@ void ReplayTimeline::maybe_add_reverse_exec_checkpoint(
   Progress now = estimate_progress();
   auto it = reverse_exec_checkpoints.rbegin();
   if (it != reverse_exec_checkpoints.rend() &&
-      it->second >= now - inter_checkpoint_interval(strategy)) {
+      it->second.progress >= now - inter_checkpoint_interval(strategy)) {
     // Latest checkpoint is close enough; we don't need to do anything.
     return;
   }
@@ -1593,14 +1596,18 @@ void ReplayTimeline::maybe_add_reverse_exec_checkpoint(
 
   Mark m = add_explicit_checkpoint();
   LOG(debug) << "Creating reverse-exec checkpoint at " << m;
-  reverse_exec_checkpoints[m] = now;
+  reverse_exec_checkpoints[m] = ReverseExecCheckpoint(now);
+
+  if (checkpoint_memory_budget) {
+    enforce_checkpoint_memory_budget(m, now);
+  }
 }
 
 void ReplayTimeline::discard_future_reverse_exec_checkpoints() {
   Progress now = estimate_progress();
   while (true) {
     auto it = reverse_exec_checkpoints.rbegin();
-    if (it == reverse_exec_checkpoints.rend() || it->second <= now) {
+    if (it == reverse_exec_checkpoints.rend() || it->second.progress <= now) {
       break;
     }
     LOG(debug) << "Discarding reverse-exec future checkpoint at "
@@ -1626,7 +1633,7 @@ void ReplayTimeline::discard_past_reverse_exec_checkpoints(
     // checkpoint entry < start in 'tmp_it'.
     auto tmp_it = it;
     while (tmp_it != reverse_exec_checkpoints.rend() &&
-           tmp_it->second >= start) {
+           tmp_it->second.progress >= start) {
       ++checkpoints_in_range;
       ++tmp_it;
     }
@@ -1650,6 +1657,67 @@ void ReplayTimeline::discard_past_reverse_exec_checkpoints(
   }
 }
 
+/*
+ * Memory-budgeted eviction:
+ *
+ * Checkpoints are forked processes sharing pages copy-on-write with each
+ * other and with the current session, so what a checkpoint really costs is
+ * the set of pages that have diverged since it was taken. That grows as
+ * replay continues to write memory, so every checkpoint is re-measured
+ * whenever we add a new one. While the total exceeds the budget we evict the
+ * checkpoint with the lowest expected reuse per byte.
+ *
+ * The expected reuse of a checkpoint is the extra replay work its eviction
+ * would cause (the Progress gap back to the previous checkpoint), weighted
+ * by how often it has been restored, and discounted by its distance behind
+ * the current position, since reverse execution mostly targets recent points.
+ */
+void ReplayTimeline::enforce_checkpoint_memory_budget(const Mark& newest,
+                                                      Progress now) {
+  uint64_t total = 0;
+  for (auto& it : reverse_exec_checkpoints) {
+    auto& checkpoint = it.first.ptr->checkpoint;
+    it.second.memory_size =
+        checkpoint ? checkpoint->private_memory_size() : 0;
+    total += it.second.memory_size;
+  }
+  LOG(debug) << "Reverse-exec checkpoints hold " << total
+             << " bytes, budget " << checkpoint_memory_budget;
+
+  while (total > checkpoint_memory_budget) {
+    Mark victim;
+    double victim_score = 0;
+    Progress prev_progress = 0;
+    for (auto& it : reverse_exec_checkpoints) {
+      Progress gap = it.second.progress - prev_progress;
+      prev_progress = it.second.progress;
+      if (it.first == newest) {
+        continue;
+      }
+      Progress distance = now - it.second.progress +
+                          expecting_reverse_exec_inter_checkpoint_interval;
+      double reuse = double(gap) * (1 + it.first.ptr->checkpoint_restores) /
+                     double(distance);
+      double score =
+          reuse / double(max<uint64_t>(it.second.memory_size, page_size()));
+      if (!victim || score < victim_score) {
+        victim = it.first;
+        victim_score = score;
+      }
+    }
+    if (!victim) {
+      // Only |newest| is left. Keep it even though we're over budget.
+      break;
+    }
+    LOG(debug) << "Evicting reverse-exec checkpoint at " << victim << " ("
+               << reverse_exec_checkpoints[victim].memory_size
+               << " bytes) to stay within memory budget";
+    total -= reverse_exec_checkpoints[victim].memory_size;
+    remove_explicit_checkpoint(victim);
+    reverse_exec_checkpoints.erase(victim);
+  }
+}
+
 ReplayTimeline::Mark ReplayTimeline::set_short_checkpoint() {
   if (!can_add_checkpoint()) {
     return mark();
@@ -31,7 +31,8 @@ private:
 
 public:
   ReplayTimeline(std::shared_ptr<ReplaySession> session);
-  ReplayTimeline() : breakpoints_applied(false) {}
+  ReplayTimeline()
+      : breakpoints_applied(false), checkpoint_memory_budget(0) {}
   ~ReplayTimeline();
 
   bool is_running() const { return current != nullptr; }
@@ -259,6 +260,15 @@ public:
    */
   void apply_breakpoints_and_watchpoints();
 
+  /**
+   * Limit the total tracee memory held privately by reverse-exec checkpoints
+   * to approximately |bytes|. Zero (the default) means no limit; checkpoints
+   * are then only bounded by the count/spacing heuristics.
+   */
+  void set_checkpoint_memory_budget(uint64_t bytes) {
+    checkpoint_memory_budget = bytes;
+  }
+
 private:
   /**
    * A MarkKey consists of FrameTime + Ticks + ReplayStepKey. These values
@@ -337,6 +347,7 @@ private:
           proto(key),
           ticks_at_event_start(session.ticks_at_start_of_current_event()),
           checkpoint_refcount(0),
+          checkpoint_restores(0),
           singlestep_to_next_mark_no_signal(false) {
       ReplayTask* t = session.current_task();
       if (t) {
@@ -360,6 +371,8 @@ private:
     Ticks ticks_at_event_start;
     // Number of users of `checkpoint`.
     uint32_t checkpoint_refcount;
+    // Number of times we've restored a session from `checkpoint`.
+    uint32_t checkpoint_restores;
     // The next InternalMark in the ReplayTimeline's Mark vector is the result
     // of singlestepping from this mark *and* no signal is reported in the
     // break_status when doing such a singlestep.
@@ -451,6 +464,11 @@ private:
    * useless).
    */
   void discard_future_reverse_exec_checkpoints();
+  /**
+   * Evict reverse-exec checkpoints other than |newest| until the memory
+   * they hold privately fits within checkpoint_memory_budget.
+   */
+  void enforce_checkpoint_memory_budget(const Mark& newest, Progress now);
 
   Mark set_short_checkpoint();
 
@@ -510,10 +528,21 @@ private:
 
   FrameTime reverse_execution_barrier_event_;
 
+  struct ReverseExecCheckpoint {
+    ReverseExecCheckpoint() : progress(0), memory_size(0) {}
+    explicit ReverseExecCheckpoint(Progress progress)
+        : progress(progress), memory_size(0) {}
+    Progress progress;
+    // Private memory held by the checkpoint when last measured.
+    uint64_t memory_size;
+  };
+
   /**
    * Checkpoints used to accelerate reverse execution.
    */
-  std::map<Mark, Progress> reverse_exec_checkpoints;
+  std::map<Mark, ReverseExecCheckpoint> reverse_exec_checkpoints;
+
+  uint64_t checkpoint_memory_budget;
 
   /**
    * When these are non-null, then when singlestepping from
@@ -88,6 +88,8 @@ Scheduler::Scheduler(RecordSession& session)
     : reschedule_count(0),
       session(session),
       task_priority_set_total_count(0),
+      parked_task_count(0),
+      reschedules_since_unpark_all(0),
       current_(nullptr),
       current_timeslice_end_(0),
       high_priority_only_intervals_refresh_time(0),
@@ -190,12 +192,28 @@ static bool treat_syscall_as_nonblocking(int syscallno, SupportedArch arch) {
          is_exit_group_syscall(syscallno, arch);
 }
 
+// With at least this many tasks, reschedule() gathers all pending stops
+// before looking for a runnable task, and parks tasks it finds blocked.
+static const size_t EAGER_POLL_STOPS_TASK_COUNT = 200;
+// Parked tasks should always be unparked by a stop notification or by
+// did_change_task_state, but as a safety net we also unpark everything this
+// often.
+static const int UNPARK_ALL_INTERVAL = 256;
+
 class WaitAggregator {
 public:
   explicit WaitAggregator(int num_waits_before_polling_stops) :
     num_waits_before_polling_stops(num_waits_before_polling_stops),
     did_poll_stops(false) {}
   bool try_wait(RecordTask* t);
+  // Gather all pending stops now. After this, try_wait() never makes a
+  // syscall.
+  void poll_stops_now() {
+    if (!did_poll_stops) {
+      WaitManager::poll_stops();
+      did_poll_stops = true;
+    }
+  }
   // Return a list of tasks that we should check for unexpected exits.
   const vector<RecordTask*>& exit_candidates() { return exit_candidates_; }
   static bool try_wait_exit(RecordTask* t);
@@ -216,8 +234,7 @@ bool WaitAggregator::try_wait(RecordTask* t) {
     if (num_waits_before_polling_stops > 0) {
       --num_waits_before_polling_stops;
     } else {
-      WaitManager::poll_stops();
-      did_poll_stops = true;
+      poll_stops_now();
     }
   }
 
@@ -387,7 +404,8 @@ bool Scheduler::is_task_runnable(RecordTask* t, WaitAggregator& wait_aggregator,
 
 RecordTask* Scheduler::find_next_runnable_task(WaitAggregator& wait_aggregator,
                                                map<int, vector<RecordTask*>>& attention_set_by_priority,
-                                               bool* by_waitpid, int priority_threshold) {
+                                               bool* by_waitpid, int priority_threshold,
+                                               bool park_blocked_tasks) {
   *by_waitpid = false;
 
   // The outer loop has one iteration per unique priority value.
@@ -429,10 +447,20 @@ RecordTask* Scheduler::find_next_runnable_task(WaitAggregator& wait_aggregator,
       // Every time we schedule a new task we put it last on the list.
       // Thus starting from the beginning essentially gives us round-robin
       // behavior at each task priority level.
-      for (RecordTask* t : same_priority_tasks.tasks) {
+      auto& tasks = same_priority_tasks.tasks;
+      for (auto it = tasks.begin(); it != tasks.end();) {
+        RecordTask* t = *it;
         if (is_task_runnable(t, wait_aggregator, by_waitpid)) {
           return t;
         }
+        if (park_blocked_tasks && can_park_task(t)) {
+          LOGM(debug) << "  parking " << t->tid;
+          it = tasks.erase(it);
+          same_priority_tasks.parked_tasks.insert(t);
+          ++parked_task_count;
+        } else {
+          ++it;
+        }
       }
     }
   }
@@ -469,10 +497,13 @@ void Scheduler::maybe_reset_priorities(double now) {
   priorities_refresh_time =
       now + random_frac() * priorities_refresh_max_interval;
   vector<RecordTask*> tasks;
-  for (auto p : task_priority_set) {
+  for (auto& p : task_priority_set) {
     for (RecordTask* t : p.second.tasks) {
       tasks.push_back(t);
     }
+    for (RecordTask* t : p.second.parked_tasks) {
+      tasks.push_back(t);
+    }
   }
   for (RecordTask* t : task_round_robin_queue) {
     tasks.push_back(t);
@@ -737,10 +768,38 @@ Scheduler::Rescheduled Scheduler::reschedule(Switchable switchable) {
     maybe_reset_high_priority_only_intervals(now);
     last_reschedule_in_high_priority_only_interval =
         in_high_priority_only_interval(now);
-    WaitAggregator wait_aggregator((task_priority_set_total_count + task_round_robin_queue.size())/100 + 1);
-
+    size_t task_count = task_priority_set_total_count + task_round_robin_queue.size();
+    WaitAggregator wait_aggregator(task_count/100 + 1);
+
+    unordered_set<pid_t> attention_tids = TraceeAttentionSet::read();
+    bool park_blocked_tasks =
+        !enable_chaos && task_count >= EAGER_POLL_STOPS_TASK_COUNT;
+    if (parked_task_count &&
+        (!park_blocked_tasks ||
+         ++reschedules_since_unpark_all >= UNPARK_ALL_INTERVAL)) {
+      unpark_all_tasks();
+    }
+    if (task_count >= EAGER_POLL_STOPS_TASK_COUNT) {
+      // With many tasks, probing them one at a time is O(tasks) per
+      // scheduling decision. Drain all pending stops up front instead
+      // (one waitid per stopped task) so the attention set is exactly the
+      // set of tasks that have stopped, and we usually find the next task
+      // without touching the others.
+      wait_aggregator.poll_stops_now();
+      for (pid_t tid : WaitManager::stopped_tids()) {
+        attention_tids.insert(tid);
+      }
+    }
     map<int, vector<RecordTask*>> attention_set_by_priority;
-    for (pid_t tid : TraceeAttentionSet::read()) {
+    for (pid_t tid : attention_tids) {
+      if (parked_task_count) {
+        // Anything that has reported a status may have become runnable.
+        // This includes current_.
+        RecordTask* t = session.find_task(tid);
+        if (t) {
+          unpark_task(t);
+        }
+      }
       if (current_ && current_->tid == tid) {
         // current_ will almost always be in the attention set because of
         // ptrace-stop activity related to when we last ran it.
@@ -758,7 +817,7 @@ Scheduler::Rescheduled Scheduler::reschedule(Switchable switchable) {
       RecordTask* round_robin_task = get_round_robin_task();
       if (!round_robin_task) {
         next = find_next_runnable_task(wait_aggregator, attention_set_by_priority, &result.by_waitpid,
-                                       current_->priority - 1);
+                                       current_->priority - 1, park_blocked_tasks);
         if (next) {
           // There is a runnable higher-priority task. Run it.
           break;
@@ -798,7 +857,15 @@ Scheduler::Rescheduled Scheduler::reschedule(Switchable switchable) {
       continue;
     }
 
-    next = find_next_runnable_task(wait_aggregator, attention_set_by_priority, &result.by_waitpid, INT32_MAX);
+    next = find_next_runnable_task(wait_aggregator, attention_set_by_priority, &result.by_waitpid, INT32_MAX,
+                                   park_blocked_tasks);
+    if (!next && parked_task_count) {
+      // Before concluding that everything is blocked, look at every task
+      // again; this also makes them all exit candidates below.
+      unpark_all_tasks();
+      next = find_next_runnable_task(wait_aggregator, attention_set_by_priority, &result.by_waitpid, INT32_MAX,
+                                     false);
+    }
     if (!next && !wait_aggregator.exit_candidates().empty()) {
       // We need to check for tasks that have unexpectedly exited.
       // First check if there is any exit status pending. Normally there won't be.
@@ -955,10 +1022,45 @@ void Scheduler::insert_into_task_priority_set(RecordTask* t) {
 }
 
 void Scheduler::remove_from_task_priority_set(RecordTask* t) {
-  task_priority_set[t->priority].tasks.erase(t);
+  SamePriorityTasks& same_priority_tasks = task_priority_set[t->priority];
+  if (same_priority_tasks.parked_tasks.erase(t)) {
+    --parked_task_count;
+  } else {
+    same_priority_tasks.tasks.erase(t);
+  }
   --task_priority_set_total_count;
 }
 
+bool Scheduler::can_park_task(RecordTask* t) {
+  // These are exactly the tasks for which is_task_runnable is decided by
+  // try_wait, i.e. by whether the kernel reported a status for them.
+  return t != current_ && !t->detached_proxy && !t->waiting_for_reap &&
+         t->may_be_blocked() && !t->waiting_for_zombie &&
+         t->emulated_stop_type == NOT_STOPPED &&
+         !t->waiting_for_ptrace_exit && t->is_running();
+}
+
+void Scheduler::unpark_task(RecordTask* t) {
+  if (t->in_round_robin_queue) {
+    return;
+  }
+  auto it = task_priority_set.find(t->priority);
+  if (it != task_priority_set.end() && it->second.parked_tasks.erase(t)) {
+    it->second.tasks.insert(t);
+    --parked_task_count;
+  }
+}
+
+void Scheduler::unpark_all_tasks() {
+  for (auto& p : task_priority_set) {
+    p.second.tasks.insert(p.second.parked_tasks.begin(),
+                          p.second.parked_tasks.end());
+    p.second.parked_tasks.clear();
+  }
+  parked_task_count = 0;
+  reschedules_since_unpark_all = 0;
+}
+
 void Scheduler::on_create(RecordTask* t) {
   DEBUG_ASSERT(!t->in_round_robin_queue);
   if (enable_chaos) {
@@ -1035,7 +1137,8 @@ void Scheduler::schedule_one_round_robin(RecordTask* t) {
   maybe_pop_round_robin_task(t);
   ASSERT(t, !t->in_round_robin_queue);
 
-  for (auto p : task_priority_set) {
+  unpark_all_tasks();
+  for (auto& p : task_priority_set) {
     for (RecordTask* tt : p.second.tasks) {
       if (tt != t && !tt->in_round_robin_queue) {
         task_round_robin_queue.push_back(tt);
@@ -1044,6 +1147,7 @@ void Scheduler::schedule_one_round_robin(RecordTask* t) {
     }
   }
   task_priority_set.clear();
+  task_priority_set_total_count = 0;
   task_round_robin_queue.push_back(t);
   t->in_round_robin_queue = true;
   expire_timeslice();
@@ -1075,4 +1179,10 @@ void Scheduler::did_exit_execve(RecordTask* t) {
   in_exec_tgid = 0;
 }
 
+void Scheduler::did_change_task_state(RecordTask* t) {
+  if (parked_task_count) {
+    unpark_task(t);
+  }
+}
+
 } // namespace rr
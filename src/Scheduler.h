@@ -181,6 +181,12 @@ public:
    * Let the scheduler know that the task has exited an execve.
    */
   void did_exit_execve(RecordTask* t);
+  /**
+   * Let the scheduler know that rr changed the task's state in a way that
+   * may make it runnable without the kernel reporting a new status for it:
+   * rr waited for it, sent it a signal, or changed what it's waiting for.
+   */
+  void did_change_task_state(RecordTask* t);
 
 private:
   struct CompareByScheduleOrder {
@@ -189,6 +195,12 @@ private:
   struct SamePriorityTasks {
     // Tasks ordered in of last-scheduled, most recently scheduled last
     std::set<RecordTask*, CompareByScheduleOrder> tasks;
+    // Tasks that were found blocked in the kernel after all pending stops
+    // had been gathered. They can't become runnable without reporting a
+    // new wait status or rr changing their state, so
+    // find_next_runnable_task skips them until they show up in the attention
+    // set or did_change_task_state is called. Same ordering as `tasks`.
+    std::set<RecordTask*, CompareByScheduleOrder> parked_tasks;
     int consecutive_uses_of_attention_set;
 
     SamePriorityTasks() : consecutive_uses_of_attention_set(0) {}
@@ -208,10 +220,13 @@ private:
    * be returned by get_next_thread, and is_runnable_task must not be called
    * on it again until it has run.
    * Considers only tasks with priority <= priority_threshold.
+   * If park_blocked_tasks is true, tasks found blocked are moved to
+   * parked_tasks; this requires all pending stops to have been gathered.
    */
   RecordTask* find_next_runnable_task(WaitAggregator& wait_aggregator,
                                       std::map<int, std::vector<RecordTask*>>& attention_set_by_priority,
-                                      bool* by_waitpid, int priority_threshold);
+                                      bool* by_waitpid, int priority_threshold,
+                                      bool park_blocked_tasks);
   /**
    * Returns the first task in the round-robin queue or null if it's empty,
    * removing it from the round-robin queue.
@@ -231,6 +246,9 @@ private:
 
   void insert_into_task_priority_set(RecordTask* t);
   void remove_from_task_priority_set(RecordTask* t);
+  bool can_park_task(RecordTask* t);
+  void unpark_task(RecordTask* t);
+  void unpark_all_tasks();
 
   uint64_t reschedule_count;
 
@@ -249,6 +267,11 @@ private:
    */
   TaskPrioritySet task_priority_set;
   size_t task_priority_set_total_count;
+  // Number of tasks in some parked_tasks set. Included in
+  // task_priority_set_total_count.
+  size_t parked_task_count;
+  // Reschedules since we last unparked all tasks.
+  int reschedules_since_unpark_all;
   TaskQueue task_round_robin_queue;
 
   /**
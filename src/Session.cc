@@ -160,6 +160,18 @@ vector<AddressSpace*> Session::vms() const {
   return result;
 }
 
+uint64_t Session::private_memory_size() const {
+  uint64_t result = 0;
+  for (auto& vm : vm_map) {
+    if (vm.second->task_set().empty()) {
+      continue;
+    }
+    result += read_proc_private_memory_size(
+        (*vm.second->task_set().begin())->tid);
+  }
+  return result;
+}
+
 Task* Session::clone(Task* p, int flags, remote_ptr<void> stack,
                      remote_ptr<void> tls, remote_ptr<int> cleartid_addr,
                      pid_t new_tid, pid_t new_rec_tid) {
@@ -685,7 +697,6 @@ void Session::copy_state_to(Session& dest, EmuFs& emu_fs, EmuFs& dest_emu_fs) {
     LOG(debug) << "  forked new group leader " << group.clone_leader->tid;
 
     {
-      AutoRemoteSyscalls remote(group.clone_leader);
       vector<AddressSpace::Mapping> shared_maps_to_clone;
       for (const auto& m : group.clone_leader->vm()->maps()) {
         // Special case the syscallbuf as a performance optimization. The amount
@@ -703,9 +714,14 @@ void Session::copy_state_to(Session& dest, EmuFs& emu_fs, EmuFs& dest_emu_fs) {
           shared_maps_to_clone.push_back(m);
         }
       }
-      // Do this in a separate loop to avoid iteration invalidation issues
-      for (const auto& m : shared_maps_to_clone) {
-        remap_shared_mmap(remote, emu_fs, dest_emu_fs, m);
+      // Do this in a separate loop to avoid iteration invalidation issues.
+      // Most processes have no emulated shared mappings, in which case we
+      // don't need to set up remote syscalls at all.
+      if (!shared_maps_to_clone.empty()) {
+        AutoRemoteSyscalls remote(group.clone_leader);
+        for (const auto& m : shared_maps_to_clone) {
+          remap_shared_mmap(remote, emu_fs, dest_emu_fs, m);
+        }
       }
 
       for (auto t : vm.second->task_set()) {
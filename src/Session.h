@@ -281,6 +281,14 @@ public:
    */
   std::vector<AddressSpace*> vms() const;
 
+  /**
+   * Return the number of bytes of tracee memory that belong only to this
+   * session, i.e. roughly what would be freed by destroying it. Pages still
+   * shared copy-on-write with other sessions are not counted. This does
+   * not force a partially-initialized clone to finish initializing.
+   */
+  uint64_t private_memory_size() const;
+
   virtual RecordSession* as_record() { return nullptr; }
   virtual ReplaySession* as_replay() { return nullptr; }
   virtual DiversionSession* as_diversion() { return nullptr; }
@@ -429,6 +437,12 @@ protected:
   BreakStatus diagnose_debugger_trap(Task* t, RunCommand run_command);
   void check_for_watchpoint_changes(Task* t, BreakStatus& break_status);
 
+  // Forks each address space of this session into `dest`. Tracee memory is
+  // not copied: the fork shares it copy-on-write, so the cost of cloning
+  // (and of restoring a checkpoint, which is a clone) grows with the
+  // number of mapped pages (page table entries) and emulated shared-file
+  // data, not with the amount of memory later touched. Cloning threads
+  // and restoring their state is deferred to finish_initializing().
   void copy_state_to(Session& dest, EmuFs& emu_fs, EmuFs& dest_emu_fs);
 
   // XXX Move CloneCompletion/CaptureState etc to ReplayTask/ReplaySession
@@ -1,6 +1,7 @@
 /* -*- Mode: C++; tab-width: 8; c-basic-offset: 2; indent-tabs-mode: nil; -*- */
 
 #include <dirent.h>
+#include <pthread.h>
 #include <unistd.h>
 
 #include <set>
@@ -66,7 +67,10 @@ SourcesCommand SourcesCommand::singleton(
     "                             in the library's DW_AT_comp_dir property\n"
     "                             for all compilation units.\n"
     "                             LIBRARY is the basename of the original file name,\n"
-    "                             e.g. libc-2.32.so\n");
+    "                             e.g. libc-2.32.so\n"
+    "  --cache                    Use and update a per-binary cache of\n"
+    "                             compilation unit source files in\n"
+    "                             $XDG_CACHE_HOME/rr/sources-index.\n");
 
 class ExplicitSourcesCommand : public Command {
 public:
@@ -88,7 +92,10 @@ ExplicitSourcesCommand ExplicitSourcesCommand::singleton(
     "                             in the library's DW_AT_comp_dir property\n"
     "                             for all compilation units.\n"
     "                             LIBRARY is the basename of the original file name,\n"
-    "                             e.g. libc-2.32.so\n");
+    "                             e.g. libc-2.32.so\n"
+    "  --cache                    Use and update a per-binary cache of\n"
+    "                             compilation unit source files in\n"
+    "                             $XDG_CACHE_HOME/rr/sources-index.\n");
 
 static void dir_name(string& s) {
   size_t p = s.rfind('/');
@@ -124,15 +131,27 @@ static void prepend_path(const char* prefix, string& s) {
   }
 }
 
+// Shared by all the threads processing binaries.
 struct DirExistsCache {
+  DirExistsCache() { pthread_mutex_init(&lock, nullptr); }
+  ~DirExistsCache() { pthread_mutex_destroy(&lock); }
   unordered_map<string, bool> cache;
+  pthread_mutex_t lock;
   bool dir_exists(const string& dir) {
+    pthread_mutex_lock(&lock);
     auto it = cache.find(dir);
     if (it != cache.end()) {
-      return it->second;
+      bool exists = it->second;
+      pthread_mutex_unlock(&lock);
+      return exists;
     }
+    pthread_mutex_unlock(&lock);
+    // Don't hold the lock while we hit the filesystem. Another thread might
+    // check the same path concurrently; that's harmless.
     bool exists = access(dir.c_str(), F_OK) == 0;
+    pthread_mutex_lock(&lock);
     cache.insert(make_pair(dir, exists));
+    pthread_mutex_unlock(&lock);
     return exists;
   }
 };
@@ -215,14 +234,200 @@ struct DwoInfo {
   uint64_t id;
 };
 
-static bool process_compilation_units(ElfFileReader& reader,
+// The source-relevant data of one compilation unit, before any file names
+// are resolved. Parsing this out of the DWARF is the expensive part of
+// `rr sources`, so we cache it per binary; see read_source_index().
+// DWARF attributes that fail to parse truncate the record, exactly where
+// process_compilation_units would stop looking at the CU.
+struct CuSourceInfo {
+  enum ValidThrough {
+    // DW_AT_comp_dir has been examined; DW_AT_dwo_name failed to parse.
+    COMP_DIR,
+    // The DWO name is valid, but its DW_AT_GNU_dwo_id failed to parse.
+    DWO_NAME,
+    // DWO info is valid; DW_AT_name failed to parse.
+    DWO,
+    // DW_AT_name is valid; there's no usable line table.
+    NAME,
+    // Everything, including the line table files, is valid.
+    LINES
+  };
+  CuSourceInfo()
+      : valid_through(COMP_DIR), comp_dir_ok(false), has_comp_dir(false),
+        has_dwo_name(false), has_dwo_id(false), dwo_id(0), has_name(false) {}
+  uint8_t valid_through;
+  bool comp_dir_ok;
+  bool has_comp_dir;
+  bool has_dwo_name;
+  bool has_dwo_id;
+  uint64_t dwo_id;
+  bool has_name;
+  string comp_dir;
+  string dwo_name;
+  string name;
+  struct File {
+    bool has_dir;
+    string dir;
+    string name;
+  };
+  vector<File> files;
+};
+
+// Where cached CuSourceInfo is stored, or empty if we're not caching.
+// Set before any worker threads start.
+static string source_index_dir;
+
+// Creates the cache directory if needed. Failure just disables caching.
+static void init_source_index_dir() {
+  source_index_dir = rr_cache_dir("sources-index");
+  if (source_index_dir.empty()) {
+    LOG(warn) << "Not caching source indexes";
+  }
+}
+
+static const char SOURCE_INDEX_MAGIC[] = "rrsrcidx1";
+
+static string source_index_path(ElfFileReader& reader, const string& build_id) {
+  if (source_index_dir.empty() || build_id.empty()) {
+    return string();
+  }
+  // A binary and its separate debuginfo file share a build-id, so identify
+  // the DWARF sections too.
+  SectionOffsets info = reader.find_section_file_offsets(".debug_info");
+  if (!info.start) {
+    info = reader.find_section_file_offsets(".zdebug_info");
+  }
+  SectionOffsets line = reader.find_section_file_offsets(".debug_line");
+  if (!line.start) {
+    line = reader.find_section_file_offsets(".zdebug_line");
+  }
+  if (!info.start || !line.start) {
+    return string();
+  }
+  char buf[100];
+  sprintf(buf, "-%llx-%llx-%llx-%llx", (unsigned long long)info.start,
+          (unsigned long long)(info.end - info.start),
+          (unsigned long long)line.start,
+          (unsigned long long)(line.end - line.start));
+  return source_index_dir + "/" + build_id + buf;
+}
+
+static void write_index_string(FILE* f, const string& s) {
+  uint32_t len = s.size();
+  fwrite(&len, sizeof(len), 1, f);
+  fwrite(s.data(), 1, len, f);
+}
+
+static bool read_index_string(FILE* f, uint64_t file_size, string* s) {
+  uint32_t len;
+  if (fread(&len, sizeof(len), 1, f) != 1) {
+    return false;
+  }
+  // Don't trust a corrupt length to size the allocation.
+  long pos = ftell(f);
+  if (pos < 0 || len > file_size - (uint64_t)pos) {
+    return false;
+  }
+  s->resize(len);
+  return fread(&(*s)[0], 1, len, f) == len;
+}
+
+static void write_source_index(const string& path,
+                               const vector<CuSourceInfo>& cus) {
+  string tmp_path = path + ".tmp" + to_string(getpid()) + "-" +
+                    to_string(pthread_self());
+  FILE* f = fopen(tmp_path.c_str(), "w");
+  if (!f) {
+    LOG(warn) << "Can't write source index " << tmp_path;
+    return;
+  }
+  fwrite(SOURCE_INDEX_MAGIC, sizeof(SOURCE_INDEX_MAGIC), 1, f);
+  uint64_t count = cus.size();
+  fwrite(&count, sizeof(count), 1, f);
+  for (auto& cu : cus) {
+    uint8_t flags[6] = { cu.valid_through, cu.comp_dir_ok, cu.has_comp_dir,
+                         cu.has_dwo_name, cu.has_dwo_id, cu.has_name };
+    fwrite(flags, sizeof(flags), 1, f);
+    fwrite(&cu.dwo_id, sizeof(cu.dwo_id), 1, f);
+    write_index_string(f, cu.comp_dir);
+    write_index_string(f, cu.dwo_name);
+    write_index_string(f, cu.name);
+    uint64_t file_count = cu.files.size();
+    fwrite(&file_count, sizeof(file_count), 1, f);
+    for (auto& file : cu.files) {
+      uint8_t has_dir = file.has_dir;
+      fwrite(&has_dir, sizeof(has_dir), 1, f);
+      write_index_string(f, file.dir);
+      write_index_string(f, file.name);
+    }
+  }
+  bool ok = !ferror(f);
+  ok = fclose(f) == 0 && ok;
+  if (!ok || rename(tmp_path.c_str(), path.c_str()) < 0) {
+    LOG(warn) << "Can't write source index " << path;
+    unlink(tmp_path.c_str());
+  }
+}
+
+static bool read_source_index(const string& path, vector<CuSourceInfo>* cus) {
+  FILE* f = fopen(path.c_str(), "r");
+  if (!f) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fileno(f), &st) < 0) {
+    fclose(f);
+    return false;
+  }
+  uint64_t file_size = st.st_size;
+  char magic[sizeof(SOURCE_INDEX_MAGIC)];
+  uint64_t count;
+  bool ok = fread(magic, sizeof(magic), 1, f) == 1 &&
+            !memcmp(magic, SOURCE_INDEX_MAGIC, sizeof(magic)) &&
+            fread(&count, sizeof(count), 1, f) == 1;
+  for (uint64_t i = 0; ok && i < count; ++i) {
+    CuSourceInfo cu;
+    uint8_t flags[6];
+    uint64_t file_count;
+    ok = fread(flags, sizeof(flags), 1, f) == 1 &&
+         fread(&cu.dwo_id, sizeof(cu.dwo_id), 1, f) == 1 &&
+         read_index_string(f, file_size, &cu.comp_dir) &&
+         read_index_string(f, file_size, &cu.dwo_name) &&
+         read_index_string(f, file_size, &cu.name) &&
+         fread(&file_count, sizeof(file_count), 1, f) == 1;
+    if (!ok) {
+      break;
+    }
+    cu.valid_through = flags[0];
+    cu.comp_dir_ok = flags[1];
+    cu.has_comp_dir = flags[2];
+    cu.has_dwo_name = flags[3];
+    cu.has_dwo_id = flags[4];
+    cu.has_name = flags[5];
+    for (uint64_t j = 0; ok && j < file_count; ++j) {
+      CuSourceInfo::File file;
+      uint8_t has_dir;
+      ok = fread(&has_dir, sizeof(has_dir), 1, f) == 1 &&
+           read_index_string(f, file_size, &file.dir) &&
+           read_index_string(f, file_size, &file.name);
+      file.has_dir = has_dir;
+      cu.files.push_back(std::move(file));
+    }
+    cus->push_back(std::move(cu));
+  }
+  fclose(f);
+  if (!ok) {
+    LOG(warn) << "Ignoring corrupt source index " << path;
+    cus->clear();
+  }
+  return ok;
+}
+
+// Parse the source-relevant data out of every compilation unit.
+// Returns false if there's no usable DWARF.
+static bool extract_compilation_units(ElfFileReader& reader,
                                       ElfFileReader* sup_reader,
-                                      const string& trace_relative_name,
-                                      const string& original_file_name,
-                                      const string& comp_dir_substitution,
-                                      set<string>* file_names, vector<DwoInfo>* dwos,
-                                      DirExistsCache& dir_exists_cache) {
-  string build_id = reader.read_buildid();
+                                      vector<CuSourceInfo>* cus) {
   DwarfSpan debug_info = reader.dwarf_section(".debug_info");
   if (debug_info.empty()) {
     debug_info = reader.dwarf_section(".zdebug_info", true);
@@ -271,16 +476,15 @@ static bool process_compilation_units(ElfFileReader& reader,
     } else {
       cu.set_str_offsets_base(0);
     }
-    const char* original_comp_dir = cu.die().string_attr(cu, DW_AT_comp_dir, debug_strs, &ok);;
-    const char* comp_dir;
-    if (!comp_dir_substitution.empty()) {
-      comp_dir = comp_dir_substitution.c_str();
-    } else {
-      comp_dir = original_comp_dir;
-      if (!ok) {
-        continue;
-      }
+    cus->push_back(CuSourceInfo());
+    CuSourceInfo& info = cus->back();
+    const char* comp_dir = cu.die().string_attr(cu, DW_AT_comp_dir, debug_strs, &ok);
+    info.comp_dir_ok = ok;
+    if (comp_dir) {
+      info.has_comp_dir = true;
+      info.comp_dir = comp_dir;
     }
+    ok = true;
     const char* dwo_name = cu.die().string_attr(cu, DW_AT_GNU_dwo_name, debug_strs, &ok);
     if (!ok || !dwo_name) {
       dwo_name = cu.die().string_attr(cu, DW_AT_dwo_name, debug_strs, &ok);
@@ -288,7 +492,10 @@ static bool process_compilation_units(ElfFileReader& reader,
         continue;
       }
     }
+    info.valid_through = CuSourceInfo::DWO_NAME;
     if (dwo_name) {
+      info.has_dwo_name = true;
+      info.dwo_name = dwo_name;
       bool has_dwo_id = false;
       uint64_t dwo_id = cu.dwo_id();
       if (dwo_id != 0) {
@@ -300,30 +507,18 @@ static bool process_compilation_units(ElfFileReader& reader,
           continue;
         }
       }
-      if (has_dwo_id) {
-        string full_name;
-        if (resolve_file_name(original_file_name.c_str(), comp_dir, original_comp_dir, comp_dir_substitution, nullptr, dwo_name, dir_exists_cache, full_name)) {
-          string c;
-          if (comp_dir) {
-            c = comp_dir;
-          }
-          dwos->push_back({ dwo_name, trace_relative_name, build_id, std::move(c), full_name, dwo_id });
-        } else {
-          FATAL() << "DWO missing due to relative path " << full_name;
-        }
-      } else {
-        LOG(warn) << "DW_AT_GNU_dwo_name but not DW_AT_GNU_dwo_id";
-      }
+      info.has_dwo_id = has_dwo_id;
+      info.dwo_id = dwo_id;
     }
+    info.valid_through = CuSourceInfo::DWO;
     const char* source_file_name = cu.die().string_attr(cu, DW_AT_name, debug_strs, &ok);
     if (!ok) {
       continue;
     }
+    info.valid_through = CuSourceInfo::NAME;
     if (source_file_name) {
-      string full_name;
-      if (resolve_file_name(original_file_name.c_str(), comp_dir, original_comp_dir, comp_dir_substitution, nullptr, source_file_name, dir_exists_cache, full_name)) {
-        file_names->insert(full_name);
-      }
+      info.has_name = true;
+      info.name = source_file_name;
     }
     intptr_t stmt_list = cu.die().section_ptr_attr(DW_AT_stmt_list, &ok);
     if (stmt_list < 0 || !ok) {
@@ -333,18 +528,90 @@ static bool process_compilation_units(ElfFileReader& reader,
     if (!ok) {
       continue;
     }
+    info.valid_through = CuSourceInfo::LINES;
     for (auto& f : lines.file_names()) {
       if (!f.file_name) {
         // Already resolved above.
         continue;
       }
       const char* dir = lines.directories()[f.directory_index];
+      info.files.push_back({ dir != nullptr, dir ? dir : "", f.file_name });
+    }
+  } while (!debug_info.empty());
+
+  return true;
+}
+
+static bool process_compilation_units(ElfFileReader& reader,
+                                      ElfFileReader* sup_reader,
+                                      const string& trace_relative_name,
+                                      const string& original_file_name,
+                                      const string& comp_dir_substitution,
+                                      set<string>* file_names, vector<DwoInfo>* dwos,
+                                      DirExistsCache& dir_exists_cache) {
+  string build_id = reader.read_buildid();
+  vector<CuSourceInfo> cus;
+  string index_path = source_index_path(reader, build_id);
+  if (index_path.empty() || !read_source_index(index_path, &cus)) {
+    if (!extract_compilation_units(reader, sup_reader, &cus)) {
+      return false;
+    }
+    if (!index_path.empty()) {
+      write_source_index(index_path, cus);
+    }
+  } else {
+    LOG(debug) << "Using source index " << index_path;
+  }
+
+  for (auto& info : cus) {
+    const char* original_comp_dir = info.has_comp_dir ? info.comp_dir.c_str() : nullptr;
+    const char* comp_dir;
+    if (!comp_dir_substitution.empty()) {
+      comp_dir = comp_dir_substitution.c_str();
+    } else {
+      comp_dir = original_comp_dir;
+      if (!info.comp_dir_ok) {
+        continue;
+      }
+    }
+    if (info.valid_through < CuSourceInfo::DWO_NAME) {
+      continue;
+    }
+    if (info.has_dwo_name) {
+      if (info.valid_through < CuSourceInfo::DWO) {
+        continue;
+      }
+      if (info.has_dwo_id) {
+        string full_name;
+        if (resolve_file_name(original_file_name.c_str(), comp_dir, original_comp_dir, comp_dir_substitution, nullptr, info.dwo_name.c_str(), dir_exists_cache, full_name)) {
+          string c;
+          if (comp_dir) {
+            c = comp_dir;
+          }
+          dwos->push_back({ info.dwo_name, trace_relative_name, build_id, std::move(c), full_name, info.dwo_id });
+        } else {
+          FATAL() << "DWO missing due to relative path " << full_name;
+        }
+      } else {
+        LOG(warn) << "DW_AT_GNU_dwo_name but not DW_AT_GNU_dwo_id";
+      }
+    }
+    if (info.valid_through < CuSourceInfo::NAME) {
+      continue;
+    }
+    if (info.has_name) {
       string full_name;
-      if (resolve_file_name(original_file_name.c_str(), comp_dir, original_comp_dir, comp_dir_substitution, dir, f.file_name, dir_exists_cache, full_name)) {
+      if (resolve_file_name(original_file_name.c_str(), comp_dir, original_comp_dir, comp_dir_substitution, nullptr, info.name.c_str(), dir_exists_cache, full_name)) {
         file_names->insert(full_name);
       }
     }
-  } while (!debug_info.empty());
+    for (auto& f : info.files) {
+      string full_name;
+      if (resolve_file_name(original_file_name.c_str(), comp_dir, original_comp_dir, comp_dir_substitution, f.has_dir ? f.dir.c_str() : nullptr, f.name.c_str(), dir_exists_cache, full_name)) {
+        file_names->insert(full_name);
+      }
+    }
+  }
 
   return true;
 }
@@ -763,7 +1030,138 @@ struct OutputCompDirSubstitution {
   string substitution;
 };
 
-static int sources(const map<string, string>& binary_file_names, const map<string, string>& comp_dir_substitutions, bool is_explicit) {
+// Everything we learn from one binary in the trace. Binaries are processed
+// in parallel, then their results are merged in order.
+struct BinaryResult {
+  BinaryResult() : is_elf(false), has_comp_dir_substitution(false),
+                   has_source_files(false) {}
+  bool is_elf;
+  bool has_comp_dir_substitution;
+  bool has_source_files;
+  string trace_relative_name;
+  string comp_dir_substitution;
+  // Must be absolute.
+  set<string> file_names;
+  set<ExternalDebugInfo> external_debug_info;
+  vector<DwoInfo> dwos;
+};
+
+static void process_binary(const string& trace_file_name,
+                           const string& original_file_name,
+                           const map<string, string>& comp_dir_substitutions,
+                           bool is_explicit, DirExistsCache& dir_exists_cache,
+                           BinaryResult* result) {
+  string trace_relative_name = trace_file_name;
+  string original_name = original_file_name;
+  const char* file_name = is_explicit ? original_name.c_str() : trace_relative_name.c_str();
+  ScopedFd fd(file_name, O_RDONLY);
+  if (!fd.is_open()) {
+    FATAL() << "Can't open " << file_name;
+  }
+  LOG(info) << "Examining " << file_name;
+  ElfFileReader reader(fd);
+  if (!reader.ok()) {
+    LOG(info) << "Probably not an ELF file, skipping";
+    return;
+  }
+  result->is_elf = true;
+  if (!is_explicit) {
+    base_name(trace_relative_name);
+  }
+  base_name(original_name);
+  Debugaltlink debugaltlink = reader.read_debugaltlink();
+
+  string full_altfile_name;
+  auto altlink_reader = find_auxiliary_file(original_file_name, debugaltlink.file_name,
+                                            full_altfile_name);
+
+  bool has_source_files;
+  LOG(debug) << "Looking for comp_dir substitutions for " << original_name;
+  auto it = comp_dir_substitutions.find(original_name);
+  if (it != comp_dir_substitutions.end()) {
+    LOG(debug) << "\tFound comp_dir substitution " << it->second;
+    result->has_comp_dir_substitution = true;
+    result->comp_dir_substitution = it->second;
+    has_source_files = process_compilation_units(reader, altlink_reader.get(),
+                                                 trace_relative_name, original_file_name,
+                                                 it->second, &result->file_names,
+                                                 &result->dwos, dir_exists_cache);
+  } else {
+    LOG(debug) << "\tNo comp_dir substitution found";
+    has_source_files = process_compilation_units(reader, altlink_reader.get(),
+                                                 trace_relative_name, original_file_name,
+                                                 {}, &result->file_names,
+                                                 &result->dwos, dir_exists_cache);
+  }
+  /* If the original binary had source files, force the inclusion of any debugaltlink
+   * file, even if it does not itself have compilation units (it may have relevant strings)
+   */
+  const bool original_had_source_files = has_source_files;
+
+  Debuglink debuglink = reader.read_debuglink();
+  has_source_files |= try_debuglink_file(reader, trace_relative_name, original_file_name,
+                                         &result->file_names, debuglink.file_name,
+                                         comp_dir_substitutions, &result->dwos,
+                                         &result->external_debug_info, dir_exists_cache);
+
+  if (altlink_reader) {
+    has_source_files |= process_auxiliary_file(reader, *altlink_reader, nullptr,
+                                               trace_relative_name, original_file_name,
+                                               &result->file_names, full_altfile_name,
+                                               DEBUGALTLINK, comp_dir_substitutions,
+                                               &result->dwos, &result->external_debug_info,
+                                               original_had_source_files, dir_exists_cache);
+  }
+
+  if (!result->dwos.empty()) {
+    /* If there are any dwos, check for a dwp. */
+    string dwp_candidate = original_file_name + ".dwp";
+    struct stat statbuf;
+    int ret = stat(dwp_candidate.c_str(), &statbuf);
+    if (ret == 0 && S_ISREG(statbuf.st_mode)) {
+      string build_id = reader.read_buildid();
+      if (!build_id.empty()) {
+        result->external_debug_info.insert({ dwp_candidate, build_id, string(DWP) });
+      } else {
+        LOG(warn) << "Main ELF binary has no build ID!";
+      }
+    }
+  }
+
+  if (!has_source_files) {
+    LOG(info) << "No debuginfo found";
+  }
+  result->has_source_files = has_source_files;
+  result->trace_relative_name = std::move(trace_relative_name);
+}
+
+struct ProcessBinariesState {
+  const vector<pair<string, string>>* binaries;
+  const map<string, string>* comp_dir_substitutions;
+  bool is_explicit;
+  DirExistsCache* dir_exists_cache;
+  vector<BinaryResult>* results;
+  pthread_mutex_t lock;
+  size_t next;
+};
+
+static void* process_binaries_thread(void* p) {
+  ProcessBinariesState* state = static_cast<ProcessBinariesState*>(p);
+  while (true) {
+    pthread_mutex_lock(&state->lock);
+    size_t i = state->next++;
+    pthread_mutex_unlock(&state->lock);
+    if (i >= state->binaries->size()) {
+      return nullptr;
+    }
+    auto& binary = (*state->binaries)[i];
+    process_binary(binary.first, binary.second, *state->comp_dir_substitutions,
+                   state->is_explicit, *state->dir_exists_cache,
+                   &(*state->results)[i]);
+  }
+}
+
+static int sources(const map<string, string>& binary_file_names, const map<string, string>& comp_dir_substitutions, bool is_explicit, bool use_source_index) {
   vector<string> relevant_binary_names;
   // Must be absolute.
   set<string> file_names;
@@ -771,86 +1169,47 @@ static int sources(const map<string, string>& binary_file_names, const map<strin
   vector<DwoInfo> dwos;
   vector<OutputCompDirSubstitution> output_comp_dir_substitutions;
   DirExistsCache dir_exists_cache;
-  for (auto& pair : binary_file_names) {
-    string trace_relative_name = pair.first;
-    string original_name = pair.second;
-    const char* file_name = is_explicit ? original_name.c_str() : trace_relative_name.c_str();
-    ScopedFd fd(file_name, O_RDONLY);
-    if (!fd.is_open()) {
-      FATAL() << "Can't open " << file_name;
-    }
-    LOG(info) << "Examining " << file_name;
-    ElfFileReader reader(fd);
-    if (!reader.ok()) {
-      LOG(info) << "Probably not an ELF file, skipping";
+  if (use_source_index) {
+    init_source_index_dir();
+  }
+
+  // Binaries (and their debuginfo) vary wildly in size, so threads pull
+  // binaries off a shared queue rather than taking a fixed share each.
+  vector<pair<string, string>> binaries(binary_file_names.begin(),
+                                        binary_file_names.end());
+  vector<BinaryResult> results(binaries.size());
+  ProcessBinariesState state = { &binaries, &comp_dir_substitutions,
+                                 is_explicit, &dir_exists_cache, &results,
+                                 PTHREAD_MUTEX_INITIALIZER, 0 };
+  size_t use_cpus = min<size_t>(min(20, get_num_cpus()), binaries.size());
+  vector<pthread_t> threads;
+  for (size_t i = 1; i < use_cpus; ++i) {
+    pthread_t thread;
+    pthread_create(&thread, nullptr, process_binaries_thread, &state);
+    threads.push_back(thread);
+  }
+  process_binaries_thread(&state);
+  for (pthread_t t : threads) {
+    pthread_join(t, nullptr);
+  }
+
+  for (auto& result : results) {
+    if (!result.is_elf) {
       continue;
     }
-    if (!is_explicit) {
-      base_name(trace_relative_name);
-    }
-    base_name(original_name);
-    Debugaltlink debugaltlink = reader.read_debugaltlink();
-
-    string full_altfile_name;
-    auto altlink_reader = find_auxiliary_file(pair.second, debugaltlink.file_name,
-                                              full_altfile_name);
-
-    bool has_source_files;
-    auto dwo_count = dwos.size();
-    LOG(debug) << "Looking for comp_dir substitutions for " << original_name;
-    auto it = comp_dir_substitutions.find(original_name);
-    if (it != comp_dir_substitutions.end()) {
-      LOG(debug) << "\tFound comp_dir substitution " << it->second;
-      output_comp_dir_substitutions.push_back({ trace_relative_name, it->second });
-      has_source_files = process_compilation_units(reader, altlink_reader.get(),
-                                                   trace_relative_name, pair.second,
-                                                   it->second, &file_names, &dwos, dir_exists_cache);
-    } else {
-      LOG(debug) << "\tNo comp_dir substitution found";
-      has_source_files = process_compilation_units(reader, altlink_reader.get(),
-                                                   trace_relative_name, pair.second,
-                                                   {}, &file_names, &dwos, dir_exists_cache);
-    }
-    /* If the original binary had source files, force the inclusion of any debugaltlink
-     * file, even if it does not itself have compilation units (it may have relevant strings)
-     */
-    const bool original_had_source_files = has_source_files;
-
-    Debuglink debuglink = reader.read_debuglink();
-    has_source_files |= try_debuglink_file(reader, trace_relative_name, pair.second,
-                                           &file_names, debuglink.file_name,
-                                           comp_dir_substitutions, &dwos,
-                                           &external_debug_info, dir_exists_cache);
-
-    if (altlink_reader) {
-      has_source_files |= process_auxiliary_file(reader, *altlink_reader, nullptr,
-                                                 trace_relative_name, pair.second,
-                                                 &file_names, full_altfile_name,
-                                                 DEBUGALTLINK, comp_dir_substitutions,
-                                                 &dwos, &external_debug_info,
-                                                 original_had_source_files, dir_exists_cache);
-    }
-
-    if (dwos.size() > dwo_count) {
-      /* If there are any dwos, check for a dwp. */
-      string dwp_candidate = pair.second + ".dwp";
-      struct stat statbuf;
-      int ret = stat(dwp_candidate.c_str(), &statbuf);
-      if (ret == 0 && S_ISREG(statbuf.st_mode)) {
-        string build_id = reader.read_buildid();
-        if (!build_id.empty()) {
-          external_debug_info.insert({ dwp_candidate, build_id, string(DWP) });
-        } else {
-          LOG(warn) << "Main ELF binary has no build ID!";
-        }
-      }
+    if (result.has_comp_dir_substitution) {
+      output_comp_dir_substitutions.push_back({ result.trace_relative_name,
+                                                result.comp_dir_substitution });
     }
-
-    if (has_source_files) {
-      relevant_binary_names.push_back(std::move(trace_relative_name));
-    } else {
-      LOG(info) << "No debuginfo found";
+    file_names.insert(result.file_names.begin(), result.file_names.end());
+    external_debug_info.insert(result.external_debug_info.begin(),
+                               result.external_debug_info.end());
+    dwos.insert(dwos.end(), make_move_iterator(result.dwos.begin()),
+                make_move_iterator(result.dwos.end()));
+    if (result.has_source_files) {
+      relevant_binary_names.push_back(std::move(result.trace_relative_name));
     }
+    result = BinaryResult();
   }
 
   set<string> resolved_file_names;
@@ -969,13 +1328,15 @@ static int sources(const map<string, string>& binary_file_names, const map<strin
   return 0;
 }
 
-static bool parse_sources_option(vector<string>& args, map<string, string>& comp_dir_substitutions) {
+static bool parse_sources_option(vector<string>& args, map<string, string>& comp_dir_substitutions,
+                                 bool& use_source_index) {
   if (parse_global_option(args)) {
     return true;
   }
 
   static const OptionSpec options[] = {
-    { 0, "substitute", HAS_PARAMETER }
+    { 0, "substitute", HAS_PARAMETER },
+    { 1, "cache", NO_PARAMETER }
   };
 
   ParsedOption opt;
@@ -993,6 +1354,9 @@ static bool parse_sources_option(vector<string>& args, map<string, string>& comp
       }
       break;
     }
+    case 1:
+      use_source_index = true;
+      break;
   }
 
   return true;
@@ -1000,7 +1364,8 @@ static bool parse_sources_option(vector<string>& args, map<string, string>& comp
 
 int SourcesCommand::run(vector<string>& args) {
   map<string, string> comp_dir_substitutions;
-  while (parse_sources_option(args, comp_dir_substitutions)) {
+  bool use_source_index = false;
+  while (parse_sources_option(args, comp_dir_substitutions, use_source_index)) {
   }
 
   // (Trace file name, original file name) pairs
@@ -1031,12 +1396,13 @@ int SourcesCommand::run(vector<string>& args) {
     }
   }
 
-  return sources(binary_file_names, comp_dir_substitutions, false);
+  return sources(binary_file_names, comp_dir_substitutions, false, use_source_index);
 }
 
 int ExplicitSourcesCommand::run(vector<string>& args) {
   map<string, string> comp_dir_substitutions;
-  while (parse_sources_option(args, comp_dir_substitutions)) {
+  bool use_source_index = false;
+  while (parse_sources_option(args, comp_dir_substitutions, use_source_index)) {
   }
 
   // (Trace file name, original file name) pairs
@@ -1066,7 +1432,7 @@ int ExplicitSourcesCommand::run(vector<string>& args) {
     binary_file_names.insert(make_pair(std::move(buildid), arg));
   }
 
-  return sources(binary_file_names, comp_dir_substitutions, true);
+  return sources(binary_file_names, comp_dir_substitutions, true, use_source_index);
 }
 
 } // namespace rr
@@ -2592,29 +2592,44 @@ Task::CapturedState Task::capture_state() {
 void Task::copy_state(const CapturedState& state) {
   set_regs(state.regs);
   set_extra_regs(state.extra_regs);
-  {
+  thread_areas_ = state.thread_areas;
+  syscallbuf_size = state.syscallbuf_size;
+
+  ASSERT(this, !syscallbuf_child)
+      << "Syscallbuf should not already be initialized in clone";
+  if (!state.syscallbuf_child.is_null()) {
+    // All these fields are preserved by the fork.
+    desched_fd_child = state.desched_fd_child;
+    cloned_file_data_fd_child = state.cloned_file_data_fd_child;
+    cloned_file_data_fname = state.cloned_file_data_fname;
+    syscallbuf_child = state.syscallbuf_child;
+  }
+
+  // A new clone inherits its name from the task it was cloned from, which
+  // for the clone leader (and usually for the other threads) is already
+  // the right name. Each remote syscall costs several ptrace round trips,
+  // so only set up AutoRemoteSyscalls when we actually need one; with
+  // many threads this dominates checkpoint creation.
+  bool need_set_name = state.prname != name();
+  bool need_cloned_file_data_fd =
+      !state.syscallbuf_child.is_null() && cloned_file_data_fd_child >= 0;
+  if (need_set_name || !state.thread_areas.empty() ||
+      need_cloned_file_data_fd) {
     AutoRemoteSyscalls remote(this);
-    set_name(remote, state.prname);
+    if (need_set_name) {
+      set_name(remote, state.prname);
+    }
     copy_tls(state, remote);
-    thread_areas_ = state.thread_areas;
-    syscallbuf_size = state.syscallbuf_size;
-
-    ASSERT(this, !syscallbuf_child)
-        << "Syscallbuf should not already be initialized in clone";
-    if (!state.syscallbuf_child.is_null()) {
-      // All these fields are preserved by the fork.
-      desched_fd_child = state.desched_fd_child;
-      cloned_file_data_fd_child = state.cloned_file_data_fd_child;
-      cloned_file_data_fname = state.cloned_file_data_fname;
-      if (cloned_file_data_fd_child >= 0) {
-        ScopedFd fd(cloned_file_data_fname.c_str(), session().as_record() ?
-          O_RDWR : O_RDONLY);
-        remote.infallible_send_fd_dup(fd, cloned_file_data_fd_child, O_CLOEXEC);
-        remote.infallible_lseek_syscall(
-            cloned_file_data_fd_child, state.cloned_file_data_offset, SEEK_SET);
-      }
-      syscallbuf_child = state.syscallbuf_child;
+    if (need_cloned_file_data_fd) {
+      ScopedFd fd(cloned_file_data_fname.c_str(), session().as_record() ?
+        O_RDWR : O_RDONLY);
+      remote.infallible_send_fd_dup(fd, cloned_file_data_fd_child, O_CLOEXEC);
+      remote.infallible_lseek_syscall(
+          cloned_file_data_fd_child, state.cloned_file_data_offset, SEEK_SET);
     }
+  } else if (arch() == aarch64) {
+    // copy_tls would only have set this register.
+    set_aarch64_tls_register(state.tls_register);
   }
   preload_globals = state.preload_globals;
   ASSERT(this, as->thread_locals_tuid() != tuid());
@@ -2932,8 +2947,17 @@ static ssize_t safe_pwrite64(Task* t, const void* buf, ssize_t buf_size,
   AutoRemoteSyscalls remote(t);
   int mprotect_syscallno = syscall_number_for_mprotect(t->arch());
   bool failed_access = false;
+  vector<AutoRemoteSyscalls::BatchedSyscall> unprotects;
   for (auto& m : mappings_to_fix) {
-    long ret = remote.syscall(mprotect_syscallno, m.start(), m.size(), m.prot() | PROT_WRITE);
+    unprotects.push_back(AutoRemoteSyscalls::BatchedSyscall(
+        mprotect_syscallno, m.start().as_int(), m.size(),
+        m.prot() | PROT_WRITE));
+  }
+  // The batch stops at the first failure. The mprotects below that restore
+  // the original protections are harmless for mappings we didn't get to.
+  size_t executed = remote.syscall_batch(unprotects);
+  for (size_t i = 0; i < executed; ++i) {
+    long ret = unprotects[i].result;
     if ((int)ret == -EACCES) {
       // We could be trying to write to a read-only shared file. In that case we should
       // report the error without dying.
@@ -2942,15 +2966,24 @@ static ssize_t safe_pwrite64(Task* t, const void* buf, ssize_t buf_size,
       remote.check_syscall_result(ret, mprotect_syscallno, false);
     }
   }
+  if (executed < unprotects.size() && !failed_access) {
+    remote.check_syscall_result(-ESRCH, mprotect_syscallno, false);
+  }
   ssize_t nwritten;
   if (failed_access) {
     nwritten = -1;
   } else {
     nwritten = pwrite_all_fallible(t->vm()->mem_fd(), buf, buf_size, addr.as_int());
   }
+  vector<AutoRemoteSyscalls::BatchedSyscall> restores;
   for (auto& m : mappings_to_fix) {
-    remote.infallible_syscall(mprotect_syscallno, m.start(), m.size(),
-                              m.prot());
+    restores.push_back(AutoRemoteSyscalls::BatchedSyscall(
+        mprotect_syscallno, m.start().as_int(), m.size(), m.prot()));
+  }
+  executed = remote.syscall_batch(restores);
+  for (size_t i = 0; i < restores.size(); ++i) {
+    remote.check_syscall_result(i < executed ? restores[i].result : -ESRCH,
+                                mprotect_syscallno, false);
   }
   if (failed_access) {
     errno = EACCES;
@@ -3978,6 +4011,10 @@ void Task::apply_syscall_entry_regs()
 void Task::tgkill(int sig) {
   LOG(debug) << "Sending " << sig << " to tid " << tid;
   ASSERT(this, 0 == syscall(SYS_tgkill, real_tgid(), tid, sig));
+  if (session().is_recording()) {
+    session().as_record()->scheduler().did_change_task_state(
+        static_cast<RecordTask*>(this));
+  }
 }
 
 void Task::move_to_signal_stop()
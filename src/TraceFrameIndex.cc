@@ -0,0 +1,172 @@
+/* -*- Mode: C++; tab-width: 8; c-basic-offset: 2; indent-tabs-mode: nil; -*- */
+
+#include "TraceFrameIndex.h"
+
+#include <string.h>
+#include <sys/mman.h>
+
+#include <vector>
+
+#include "RecordSession.h"
+#include "ScopedFd.h"
+#include "log.h"
+#include "util.h"
+
+using namespace std;
+
+namespace rr {
+
+static const char INDEX_MAGIC[8] = { 'r', 'r', 'f', 'i', 'd', 'x', 0, 0 };
+static const uint32_t INDEX_VERSION = 1;
+
+struct IndexHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t entry_size;
+  uint64_t count;
+  // Must match the uuid of the trace the index was built for.
+  uint8_t uuid[16];
+};
+
+TraceFrameIndex::~TraceFrameIndex() {
+  if (map) {
+    munmap(map, map_size);
+  }
+}
+
+shared_ptr<TraceFrameIndex> TraceFrameIndex::open(const TraceReader& reader) {
+  string file_name = path(reader.dir());
+  ScopedFd fd(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+  if (!fd.is_open()) {
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(IndexHeader)) {
+    LOG(warn) << "Ignoring truncated frame index " << file_name;
+    return nullptr;
+  }
+  void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    return nullptr;
+  }
+  shared_ptr<TraceFrameIndex> index(new TraceFrameIndex());
+  index->map = map;
+  index->map_size = st.st_size;
+
+  auto header = static_cast<const IndexHeader*>(map);
+  if (memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) ||
+      header->version != INDEX_VERSION ||
+      header->entry_size != sizeof(Entry) ||
+      header->count > (index->map_size - sizeof(IndexHeader)) / sizeof(Entry) ||
+      memcmp(header->uuid, reader.uuid().bytes, sizeof(header->uuid))) {
+    LOG(warn) << "Ignoring invalid or stale frame index " << file_name;
+    return nullptr;
+  }
+  index->entries = reinterpret_cast<const Entry*>(header + 1);
+  index->count = header->count;
+  return index;
+}
+
+const TraceFrameIndex::Entry* TraceFrameIndex::find(FrameTime time) const {
+  // Frames are numbered consecutively from 1.
+  if (time < 1 || (uint64_t)time > count) {
+    return nullptr;
+  }
+  const Entry* e = &entries[time - 1];
+  DEBUG_ASSERT(e->time == time);
+  return e;
+}
+
+bool TraceFrameIndex::build(const string& trace_dir) {
+  TraceReader trace(trace_dir);
+
+  // Task events are sparse, so find the TASKS position for each task event
+  // up front rather than trying to peek at the stream while scanning frames.
+  vector<pair<FrameTime, uint64_t>> task_offsets;
+  while (true) {
+    uint64_t offset = trace.substream_offset(TraceStream::TASKS);
+    FrameTime time;
+    if (trace.read_task_event(&time).type() == TraceTaskEvent::NONE) {
+      break;
+    }
+    task_offsets.push_back(make_pair(time, offset));
+  }
+  uint64_t tasks_end = trace.substream_offset(TraceStream::TASKS);
+  auto next_task = task_offsets.begin();
+
+  string file_name = path(trace.dir());
+  string tmp_name = file_name + ".tmp";
+  ScopedFd fd(tmp_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+              0400);
+  if (!fd.is_open()) {
+    LOG(error) << "Can't create " << tmp_name;
+    return false;
+  }
+
+  IndexHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  header.version = INDEX_VERSION;
+  header.entry_size = sizeof(Entry);
+  memcpy(header.uuid, trace.uuid().bytes, sizeof(header.uuid));
+  write_all(fd, &header, sizeof(header));
+
+  vector<Entry> entries;
+  static const size_t ENTRIES_PER_WRITE = 4096;
+  while (!trace.at_end()) {
+    Entry e;
+    memset(&e, 0, sizeof(e));
+    for (int s = TraceStream::SUBSTREAM_FIRST;
+         s < TraceStream::SUBSTREAM_COUNT; ++s) {
+      e.substream_offsets[s] =
+          trace.substream_offset((TraceStream::Substream)s);
+    }
+    TraceFrame frame = trace.read_frame();
+    while (next_task != task_offsets.end() && next_task->first < frame.time()) {
+      ++next_task;
+    }
+    e.substream_offsets[TraceStream::TASKS] =
+        next_task == task_offsets.end() ? tasks_end : next_task->second;
+    e.time = frame.time();
+    e.ticks = frame.ticks();
+    e.monotonic_sec = frame.monotonic_time();
+    e.tid = frame.tid();
+
+    // Consume this frame's mmaps and raw data so the next entry records
+    // where the following frame's data starts. Raw data is skipped without
+    // being decompressed.
+    while (true) {
+      bool found;
+      trace.read_mapped_region(nullptr, &found, TraceReader::DONT_VALIDATE);
+      if (!found) {
+        break;
+      }
+    }
+    TraceReader::RawDataMetadata data;
+    while (trace.read_raw_data_metadata_for_frame(data)) {
+    }
+
+    entries.push_back(e);
+    ++header.count;
+    if (entries.size() == ENTRIES_PER_WRITE) {
+      write_all(fd, entries.data(), entries.size() * sizeof(Entry));
+      entries.clear();
+    }
+  }
+  write_all(fd, entries.data(), entries.size() * sizeof(Entry));
+  if (pwrite_all_fallible(fd, &header, sizeof(header), 0) !=
+          (ssize_t)sizeof(header) ||
+      !trace.good()) {
+    unlink(tmp_name.c_str());
+    return false;
+  }
+  fd.close();
+  if (rename(tmp_name.c_str(), file_name.c_str()) < 0) {
+    LOG(error) << "Can't rename " << tmp_name << " to " << file_name;
+    unlink(tmp_name.c_str());
+    return false;
+  }
+  return true;
+}
+
+} // namespace rr
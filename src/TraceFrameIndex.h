@@ -0,0 +1,75 @@
+/* -*- Mode: C++; tab-width: 8; c-basic-offset: 2; indent-tabs-mode: nil; -*- */
+
+#ifndef RR_TRACE_FRAME_INDEX_H_
+#define RR_TRACE_FRAME_INDEX_H_
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+#include "Ticks.h"
+#include "TraceFrame.h"
+#include "TraceStream.h"
+
+namespace rr {
+
+/**
+ * An optional index over the frames of a completed trace. For every frame it
+ * stores the frame's tid, ticks and recording time, and the position of each
+ * substream just before the frame was read. This lets TraceReader jump
+ * directly to any frame without decompressing the whole events substream.
+ *
+ * The index lives in its own file in the trace directory and is produced by
+ * `rr index`, and rebuilt by `rr pack` since packing rewrites the mmaps
+ * substream. Traces without one behave exactly as before.
+ */
+class TraceFrameIndex {
+public:
+  struct Entry {
+    FrameTime time;
+    Ticks ticks;
+    double monotonic_sec;
+    int32_t tid;
+    uint32_t padding;
+    // Uncompressed offsets, see CompressedReader::tell().
+    uint64_t substream_offsets[TraceStream::SUBSTREAM_COUNT];
+  };
+
+  ~TraceFrameIndex();
+
+  /**
+   * Map the index for the trace in |trace_dir|. Returns null if there is
+   * no index or it doesn't match |reader|'s trace.
+   */
+  static std::shared_ptr<TraceFrameIndex> open(const TraceReader& reader);
+
+  /**
+   * Scan the trace in |trace_dir| and write its index. Returns false on
+   * failure.
+   */
+  static bool build(const std::string& trace_dir);
+
+  static std::string path(const std::string& trace_dir) {
+    return trace_dir + "/frame_index";
+  }
+
+  size_t size() const { return count; }
+
+  /**
+   * Return the entry for the frame at |time|, or null if there is none.
+   */
+  const Entry* find(FrameTime time) const;
+
+private:
+  TraceFrameIndex() : map(nullptr), map_size(0), entries(nullptr), count(0) {}
+
+  void* map;
+  size_t map_size;
+  const Entry* entries;
+  size_t count;
+};
+
+} // namespace rr
+
+#endif /* RR_TRACE_FRAME_INDEX_H_ */
@@ -4,7 +4,9 @@
 
 #include <inttypes.h>
 
+#include <algorithm>
 #include <limits>
+#include <map>
 #include <unordered_map>
 
 #include "preload/preload_interface.h"
@@ -38,10 +40,207 @@ protected:
 
 TraceInfoCommand TraceInfoCommand::singleton(
     "traceinfo",
-    " rr traceinfo [<trace_dir>]\n"
-    "  Dump trace header in JSON format.\n");
+    " rr traceinfo [OPTIONS] [<trace_dir>]\n"
+    "  Dump trace header in JSON format.\n"
+    "  --stats                    also report, per event type and per\n"
+    "                             syscall, how many events were recorded,\n"
+    "                             how many raw data bytes they recorded and\n"
+    "                             how many ticks elapsed before them, and\n"
+    "                             how many syscalls were buffered\n");
 
-static int dump_trace_info(const string& trace_dir, FILE* out) {
+struct TraceInfoFlags {
+  bool stats;
+
+  TraceInfoFlags() : stats(false) {}
+};
+
+static bool parse_traceinfo_arg(vector<string>& args, TraceInfoFlags& flags) {
+  if (parse_global_option(args)) {
+    return true;
+  }
+
+  static const OptionSpec options[] = {
+    { 0, "stats", NO_PARAMETER },
+  };
+  ParsedOption opt;
+  if (!Command::parse_option(args, options, &opt)) {
+    return false;
+  }
+
+  switch (opt.short_name) {
+    case 0:
+      flags.stats = true;
+      break;
+    default:
+      DEBUG_ASSERT(0 && "Unknown option");
+  }
+  return true;
+}
+
+struct EventTypeStats {
+  EventTypeStats() : count(0), raw_bytes(0), ticks(0) {}
+  uint64_t count;
+  uint64_t raw_bytes;
+  // Ticks the task executed since its previous event.
+  uint64_t ticks;
+};
+
+struct SyscallStats {
+  SyscallStats()
+      : unbuffered(0), buffered(0), unbuffered_raw_bytes(0),
+        buffered_raw_bytes(0) {}
+  uint64_t total() const { return unbuffered + buffered; }
+  uint64_t unbuffered;
+  uint64_t buffered;
+  uint64_t unbuffered_raw_bytes;
+  uint64_t buffered_raw_bytes;
+};
+
+static uint64_t raw_data_size(const TraceReader::RawDataMetadata& d) {
+  uint64_t size = d.size;
+  for (auto& h : d.holes) {
+    size -= h.size;
+  }
+  return size;
+}
+
+static void count_buffered_syscalls(const TraceReader::RawData& buf,
+                                    SupportedArch arch,
+                                    map<string, SyscallStats>& syscalls) {
+  if (buf.data.size() < sizeof(struct syscallbuf_hdr)) {
+    return;
+  }
+  auto flush_hdr = reinterpret_cast<const syscallbuf_hdr*>(buf.data.data());
+  size_t bytes = min<size_t>(flush_hdr->num_rec_bytes,
+                             buf.data.size() - sizeof(struct syscallbuf_hdr));
+  auto record_ptr = reinterpret_cast<const uint8_t*>(flush_hdr + 1);
+  auto end_ptr = record_ptr + bytes;
+  while (record_ptr + sizeof(struct syscallbuf_record) <= end_ptr) {
+    auto record = reinterpret_cast<const struct syscallbuf_record*>(record_ptr);
+    if (record->size < sizeof(*record)) {
+      LOG(warn) << "Malformed syscallbuf record";
+      return;
+    }
+    // Buffered syscalls always use the task arch
+    SyscallStats& s = syscalls[syscall_name(record->syscallno, arch)];
+    ++s.buffered;
+    s.buffered_raw_bytes += record->size - sizeof(*record);
+    record_ptr += stored_record_size(record->size);
+  }
+}
+
+/**
+ * Everything here comes from the events substream except the syscallbuf
+ * flush records; the rest of the raw data substream is skipped without
+ * decompressing it.
+ */
+static void dump_trace_stats(const string& trace_dir, FILE* out) {
+  TraceReader trace(trace_dir);
+  map<string, EventTypeStats> event_types;
+  map<string, SyscallStats> syscalls;
+  unordered_map<pid_t, Ticks> last_ticks;
+  uint64_t total_raw_bytes = 0;
+  uint64_t flush_raw_bytes = 0;
+
+  while (!trace.at_end()) {
+    TraceFrame frame = trace.read_frame();
+    const Event& ev = frame.event();
+
+    uint64_t frame_raw_bytes = 0;
+    for (auto& d : trace.raw_data_metadata_for_frame()) {
+      frame_raw_bytes += raw_data_size(d);
+    }
+    total_raw_bytes += frame_raw_bytes;
+
+    EventTypeStats& type_stats = event_types[ev.type_name()];
+    ++type_stats.count;
+    type_stats.raw_bytes += frame_raw_bytes;
+    // Tick counts are per-task and only increase while the task exists.
+    auto it = last_ticks.find(frame.tid());
+    Ticks previous = it == last_ticks.end() ? 0 : it->second;
+    if (frame.ticks() >= previous) {
+      type_stats.ticks += frame.ticks() - previous;
+    }
+    last_ticks[frame.tid()] = frame.ticks();
+
+    if (ev.is_syscall_event()) {
+      SyscallStats& s = syscalls[ev.Syscall().syscall_name()];
+      // Each traced syscall has exactly one ENTERING_SYSCALL frame; its
+      // memory writes may be recorded by other frames.
+      if (ev.Syscall().state == ENTERING_SYSCALL) {
+        ++s.unbuffered;
+      }
+      s.unbuffered_raw_bytes += frame_raw_bytes;
+    } else if (ev.type() == EV_SYSCALLBUF_FLUSH) {
+      flush_raw_bytes += frame_raw_bytes;
+      TraceReader::RawData buf;
+      if (trace.read_raw_data_for_frame(buf)) {
+        count_buffered_syscalls(buf, frame.regs().arch(), syscalls);
+      }
+    }
+    TraceReader::RawDataMetadata d;
+    while (trace.read_raw_data_metadata_for_frame(d)) {
+    }
+  }
+
+  fputs("  \"stats\":{\n", out);
+  fprintf(out,
+          "    \"uncompressedBytes\":%" PRIu64 ",\n"
+          "    \"compressedBytes\":%" PRIu64 ",\n"
+          "    \"rawDataBytes\":%" PRIu64 ",\n"
+          "    \"syscallbufFlushRawDataBytes\":%" PRIu64 ",\n",
+          trace.uncompressed_bytes(), trace.compressed_bytes(),
+          total_raw_bytes, flush_raw_bytes);
+
+  vector<pair<string, EventTypeStats>> sorted_types(event_types.begin(),
+                                                    event_types.end());
+  stable_sort(sorted_types.begin(), sorted_types.end(),
+              [](const pair<string, EventTypeStats>& a,
+                 const pair<string, EventTypeStats>& b) {
+                return a.second.count > b.second.count;
+              });
+  fputs("    \"eventTypes\":{", out);
+  for (size_t i = 0; i < sorted_types.size(); ++i) {
+    auto& e = sorted_types[i];
+    fprintf(out,
+            "%s\n      \"%s\":{\"count\":%" PRIu64 ",\"rawDataBytes\":%" PRIu64
+            ",\"ticks\":%" PRIu64 "}",
+            i > 0 ? "," : "", json_escape(e.first).c_str(), e.second.count,
+            e.second.raw_bytes, e.second.ticks);
+  }
+  fputs("\n    },\n", out);
+
+  // Syscalls that are recorded most often without the syscallbuf come first,
+  // since those are the ones worth buffering.
+  vector<pair<string, SyscallStats>> sorted_syscalls(syscalls.begin(),
+                                                     syscalls.end());
+  stable_sort(sorted_syscalls.begin(), sorted_syscalls.end(),
+              [](const pair<string, SyscallStats>& a,
+                 const pair<string, SyscallStats>& b) {
+                if (a.second.unbuffered != b.second.unbuffered) {
+                  return a.second.unbuffered > b.second.unbuffered;
+                }
+                return a.second.total() > b.second.total();
+              });
+  fputs("    \"syscalls\":{", out);
+  for (size_t i = 0; i < sorted_syscalls.size(); ++i) {
+    auto& s = sorted_syscalls[i];
+    double buffered_ratio =
+        s.second.total() ? double(s.second.buffered) / s.second.total() : 0;
+    fprintf(out,
+            "%s\n      \"%s\":{\"count\":%" PRIu64 ",\"unbuffered\":%" PRIu64
+            ",\"buffered\":%" PRIu64 ",\"bufferedRatio\":%.3f"
+            ",\"unbufferedRawDataBytes\":%" PRIu64
+            ",\"bufferedRawDataBytes\":%" PRIu64 "}",
+            i > 0 ? "," : "", json_escape(s.first).c_str(), s.second.total(),
+            s.second.unbuffered, s.second.buffered, buffered_ratio,
+            s.second.unbuffered_raw_bytes, s.second.buffered_raw_bytes);
+  }
+  fputs("\n    }\n  },\n", out);
+}
+
+static int dump_trace_info(const string& trace_dir,
+                           const TraceInfoFlags& info_flags, FILE* out) {
   int ret = 0;
   TraceReader trace(trace_dir);
 
@@ -97,6 +296,10 @@ static int dump_trace_info(const string& trace_dir, FILE* out) {
     }
   }
 
+  if (info_flags.stats) {
+    dump_trace_stats(trace_dir, out);
+  }
+
   ReplaySession::Flags flags;
   flags.redirect_stdio = false;
   flags.share_private_mappings = false;
@@ -134,7 +337,8 @@ int TraceInfoCommand::run(vector<string>& args) {
   // we only replay to the first execve.
   Flags::get_for_init().suppress_environment_warnings = true;
 
-  while (parse_global_option(args)) {
+  TraceInfoFlags flags;
+  while (parse_traceinfo_arg(args, flags)) {
   }
 
   string trace_dir;
@@ -143,7 +347,7 @@ int TraceInfoCommand::run(vector<string>& args) {
     return 1;
   }
 
-  return dump_trace_info(trace_dir, stdout);
+  return dump_trace_info(trace_dir, flags, stdout);
 }
 
 } // namespace rr
@@ -23,6 +23,7 @@
 #include "RecordSession.h"
 #include "RecordTask.h"
 #include "TaskishUid.h"
+#include "TraceFrameIndex.h"
 #include "core.h"
 #include "kernel_abi.h"
 #include "kernel_supplement.h"
@@ -144,7 +145,10 @@ string resolve_trace_name(const string& trace_name)
   return trace_name;
 }
 
-class CompressedWriterOutputStream : public kj::OutputStream {
+// Buffered so that capnp packs messages directly into the CompressedWriter's
+// buffer. A plain kj::OutputStream makes writePackedMessage allocate and
+// copy through a temporary 8KB buffer for every message.
+class CompressedWriterOutputStream : public kj::BufferedOutputStream {
 public:
   CompressedWriterOutputStream(CompressedWriter& writer) : writer(writer) {}
   virtual ~CompressedWriterOutputStream() {}
@@ -152,6 +156,12 @@ public:
   virtual void write(const void* buffer, size_t size) {
     writer.write(buffer, size);
   }
+  virtual kj::ArrayPtr<capnp::byte> getWriteBuffer() {
+    uint8_t* p;
+    size_t size;
+    writer.get_buffer(&p, &size);
+    return kj::ArrayPtr<capnp::byte>(p, size);
+  }
 
 private:
   CompressedWriter& writer;
@@ -395,6 +405,79 @@ static int check_fd(int fd) {
 // 8-byte words
 static const size_t reasonable_frame_message_words = 64;
 
+static const size_t delta_chunk_size = 8;
+
+/**
+ * Encode |data| as a delta against |base| (see Registers in rr_trace.capnp)
+ * into |delta|, then update |base| to |data|. Returns false, leaving |delta|
+ * empty, if the data should be stored in full instead.
+ */
+static bool encode_register_delta(const uint8_t* data, size_t size,
+                                  vector<uint8_t>& base,
+                                  vector<uint8_t>& delta) {
+  delta.clear();
+  if (base.size() != size || !size) {
+    base.assign(data, data + size);
+    return false;
+  }
+  size_t chunks = (size + delta_chunk_size - 1) / delta_chunk_size;
+  size_t bitmap_size = (chunks + 7) / 8;
+  delta.resize(bitmap_size);
+  for (size_t i = 0; i < chunks; ++i) {
+    size_t offset = i * delta_chunk_size;
+    size_t len = min(delta_chunk_size, size - offset);
+    if (memcmp(data + offset, base.data() + offset, len)) {
+      delta[i / 8] |= 1 << (i % 8);
+      delta.insert(delta.end(), data + offset, data + offset + len);
+      memcpy(base.data() + offset, data + offset, len);
+    }
+  }
+  if (delta.size() >= size) {
+    delta.clear();
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Apply a delta produced by encode_register_delta to |base|. If |undo| is
+ * non-null, it's set to a delta that restores |base| to its original state.
+ */
+static void apply_register_delta(const uint8_t* delta, size_t delta_size,
+                                 vector<uint8_t>& base,
+                                 vector<uint8_t>* undo = nullptr) {
+  size_t size = base.size();
+  size_t chunks = (size + delta_chunk_size - 1) / delta_chunk_size;
+  size_t bitmap_size = (chunks + 7) / 8;
+  if (!size || delta_size < bitmap_size) {
+    FATAL() << "Register delta without base registers";
+  }
+  if (undo) {
+    undo->assign(delta, delta + bitmap_size);
+  }
+  const uint8_t* p = delta + bitmap_size;
+  const uint8_t* end = delta + delta_size;
+  for (size_t i = 0; i < chunks; ++i) {
+    if (!(delta[i / 8] & (1 << (i % 8)))) {
+      continue;
+    }
+    size_t offset = i * delta_chunk_size;
+    size_t len = min(delta_chunk_size, size - offset);
+    if (size_t(end - p) < len) {
+      FATAL() << "Truncated register delta";
+    }
+    if (undo) {
+      undo->insert(undo->end(), base.data() + offset,
+                   base.data() + offset + len);
+    }
+    memcpy(base.data() + offset, p, len);
+    p += len;
+  }
+  if (p != end) {
+    FATAL() << "Invalid register delta";
+  }
+}
+
 void TraceWriter::write_frame(RecordTask* t, const Event& ev,
                               const Registers* registers,
                               const ExtraRegisters* extra_registers) {
@@ -424,14 +507,31 @@ void TraceWriter::write_frame(RecordTask* t, const Event& ev,
   }
   raw_recs.clear();
   frame.setArch(to_trace_arch(t->arch()));
+  if (is_register_keyframe(time())) {
+    register_delta_bases.clear();
+  }
+  RegisterDeltaBase& delta_base = register_delta_bases[t->tid];
   if (registers) {
     // Avoid dynamic allocation and copy
     auto raw_regs = registers->get_regs_for_trace();
-    frame.initRegisters().setRaw(Data::Reader(raw_regs.data, raw_regs.size));
+    if (encode_register_delta(raw_regs.data, raw_regs.size, delta_base.regs,
+                              register_delta)) {
+      frame.initRegisters().setDelta(
+          Data::Reader(register_delta.data(), register_delta.size()));
+    } else {
+      frame.initRegisters().setRaw(Data::Reader(raw_regs.data, raw_regs.size));
+    }
   }
   if (extra_registers) {
-    frame.initExtraRegisters().setRaw(Data::Reader(
-        extra_registers->data_bytes(), extra_registers->data_size()));
+    if (encode_register_delta(extra_registers->data_bytes(),
+                              extra_registers->data_size(),
+                              delta_base.extra_regs, register_delta)) {
+      frame.initExtraRegisters().setDelta(
+          Data::Reader(register_delta.data(), register_delta.size()));
+    } else {
+      frame.initExtraRegisters().setRaw(Data::Reader(
+          extra_registers->data_bytes(), extra_registers->data_size()));
+    }
   }
 
   auto event = frame.initEvent();
@@ -532,7 +632,7 @@ void TraceWriter::write_frame(RecordTask* t, const Event& ev,
   tick_time();
 }
 
-TraceFrame TraceReader::read_frame() {
+TraceFrame TraceReader::read_frame(ReadMode mode) {
   auto& events = reader(EVENTS);
   word buf[reasonable_frame_message_words];
   CompressedReaderInputStream stream(events);
@@ -567,12 +667,55 @@ TraceFrame TraceReader::read_frame() {
 
   SupportedArch arch = from_trace_arch(frame.getArch());
   ret.recorded_regs.set_arch(arch);
-  auto reg_data = frame.getRegisters().getRaw();
-  if (reg_data.size()) {
+  // When peeking, deltas are applied in place and then undone, and raw
+  // registers don't replace the base, so the next read_frame sees the same
+  // delta bases.
+  bool peek = mode == PEEK;
+  RegisterDeltaBase no_delta_base;
+  RegisterDeltaBase* delta_base_ptr = &no_delta_base;
+  bool keyframe = is_register_keyframe(ret.global_time);
+  if (peek) {
+    auto it = register_delta_bases.find(ret.tid_);
+    if (!keyframe && it != register_delta_bases.end()) {
+      delta_base_ptr = &it->second;
+    }
+  } else {
+    if (keyframe) {
+      register_delta_bases.clear();
+    }
+    delta_base_ptr = &register_delta_bases[ret.tid_];
+  }
+  RegisterDeltaBase& delta_base = *delta_base_ptr;
+  auto regs = frame.getRegisters();
+  auto reg_data = regs.getRaw();
+  auto reg_delta = regs.getDelta();
+  vector<uint8_t> undo;
+  if (reg_delta.size()) {
+    apply_register_delta(reg_delta.begin(), reg_delta.size(), delta_base.regs,
+                         peek ? &undo : nullptr);
+    ret.recorded_regs.set_from_trace(arch, delta_base.regs.data(),
+                                     delta_base.regs.size());
+    if (peek) {
+      apply_register_delta(undo.data(), undo.size(), delta_base.regs);
+    }
+  } else if (reg_data.size()) {
+    if (!peek) {
+      delta_base.regs.assign(reg_data.begin(), reg_data.end());
+    }
     ret.recorded_regs.set_from_trace(arch, reg_data.begin(),
                                      reg_data.size());
   }
-  auto extra_reg_data = frame.getExtraRegisters().getRaw();
+  auto extra_regs = frame.getExtraRegisters();
+  auto extra_reg_data = extra_regs.getRaw();
+  auto extra_reg_delta = extra_regs.getDelta();
+  if (extra_reg_delta.size()) {
+    apply_register_delta(extra_reg_delta.begin(), extra_reg_delta.size(),
+                         delta_base.extra_regs, peek ? &undo : nullptr);
+    extra_reg_data = Data::Reader(delta_base.extra_regs.data(),
+                                  delta_base.extra_regs.size());
+  } else if (extra_reg_data.size() && !peek) {
+    delta_base.extra_regs.assign(extra_reg_data.begin(), extra_reg_data.end());
+  }
   if (extra_reg_data.size()) {
     ExtraRegisters::Format fmt;
     switch (arch) {
@@ -596,6 +739,9 @@ TraceFrame TraceReader::read_frame() {
   } else {
     ret.recorded_extra_regs = ExtraRegisters(arch);
   }
+  if (peek && extra_reg_delta.size()) {
+    apply_register_delta(undo.data(), undo.size(), delta_base.extra_regs);
+  }
 
   auto event = frame.getEvent();
   switch (event.which()) {
@@ -1273,7 +1419,9 @@ bool TraceReader::read_raw_data_metadata_for_frame(RawDataMetadata& d) {
   for (auto& h : d.holes) {
     data_size -= h.size;
   }
-  reader(RAW_DATA).skip(data_size);
+  // Seeking avoids decompressing data we're not going to look at.
+  auto& data = reader(RAW_DATA);
+  data.seek(data.tell() + data_size);
   raw_recs.pop_back();
   return true;
 }
@@ -1464,6 +1612,16 @@ void TraceWriter::close(CloseStatus status, const TraceUuid* uuid) {
   version_fd.close();
 }
 
+double TraceWriter::compression_wait_seconds() const {
+  double result = 0;
+  for (auto& w : writers) {
+    if (w) {
+      result += w->producer_wait_seconds();
+    }
+  }
+  return result;
+}
+
 void TraceWriter::make_latest_trace() {
   string link_name = latest_trace_symlink();
   // Try to update the symlink to |this|.  We only try attempt
@@ -1493,7 +1651,7 @@ TraceFrame TraceReader::peek_frame() {
   auto saved_raw_recs = raw_recs;
   TraceFrame frame;
   if (!at_end()) {
-    frame = read_frame();
+    frame = read_frame(PEEK);
   }
   events.restore_state();
   global_time = saved_time;
@@ -1506,14 +1664,54 @@ void TraceReader::rewind() {
     reader(s).rewind();
   }
   global_time = 0;
+  register_delta_bases.clear();
   DEBUG_ASSERT(good());
 }
 
+const TraceFrameIndex* TraceReader::frame_index() {
+  if (!frame_index_loaded) {
+    frame_index_ = TraceFrameIndex::open(*this);
+    frame_index_loaded = true;
+  }
+  return frame_index_.get();
+}
+
+bool TraceReader::seek_to_frame(FrameTime time) {
+  const TraceFrameIndex* index = frame_index();
+  if (!index) {
+    return false;
+  }
+  const TraceFrameIndex::Entry* e = index->find(time);
+  if (!e) {
+    return false;
+  }
+  // Rebuild the register delta bases by decoding the frames from the
+  // preceding keyframe.
+  FrameTime keyframe = time - (time - 1) % REGISTER_KEYFRAME_INTERVAL;
+  const TraceFrameIndex::Entry* k = index->find(keyframe);
+  if (!k || !reader(EVENTS).seek(k->substream_offsets[EVENTS])) {
+    FATAL() << "Frame index doesn't match trace data";
+  }
+  global_time = keyframe - 1;
+  while (global_time < time - 1) {
+    read_frame();
+  }
+  for (Substream s = SUBSTREAM_FIRST; s < SUBSTREAM_COUNT; ++s) {
+    if (!reader(s).seek(e->substream_offsets[s])) {
+      FATAL() << "Frame index doesn't match trace data";
+    }
+  }
+  raw_recs.clear();
+  global_time = time - 1;
+  return true;
+}
+
 TraceReader::TraceReader(const string& dir)
     : TraceStream(resolve_trace_name(dir), 1) {
   for (Substream s = SUBSTREAM_FIRST; s < SUBSTREAM_COUNT; ++s) {
     readers[s] = unique_ptr<CompressedReader>(new CompressedReader(path(s)));
   }
+  frame_index_loaded = false;
 
   string path = version_path();
   ScopedFd version_fd(path.c_str(), O_RDONLY);
@@ -1674,8 +1872,11 @@ TraceReader::TraceReader(const TraceReader& other)
 
   bind_to_cpu = other.bind_to_cpu;
   trace_uses_cpuid_faulting = other.trace_uses_cpuid_faulting;
+  frame_index_ = other.frame_index_;
+  frame_index_loaded = other.frame_index_loaded;
   cpuid_records_ = other.cpuid_records_;
   raw_recs = other.raw_recs;
+  register_delta_bases = other.register_delta_bases;
   xcr0_ = other.xcr0_;
   preload_thread_locals_recorded_ = other.preload_thread_locals_recorded_;
   rrcall_base_ = other.rrcall_base_;
@@ -9,6 +9,7 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "CompressedReader.h"
@@ -25,12 +26,13 @@ namespace rr {
 /**
  * Bump this when rr changes mean that traces produced by new rr can't be replayed by old rr.
  */
-const int FORWARD_COMPATIBILITY_VERSION = 3;
+const int FORWARD_COMPATIBILITY_VERSION = 4;
 
 struct CPUIDRecord;
 struct DisableCPUIDFeatures;
 class KernelMapping;
 class RecordTask;
+class TraceFrameIndex;
 struct TraceUuid;
 
 struct WriteHole {
@@ -135,6 +137,24 @@ protected:
    */
   void tick_time() { ++global_time; }
 
+  /**
+   * Frames store registers as deltas against the previous frame of the same
+   * tid, except at keyframes, which start a new chain for every task.
+   */
+  static const FrameTime REGISTER_KEYFRAME_INTERVAL = 256;
+  static bool is_register_keyframe(FrameTime time) {
+    return (time - 1) % REGISTER_KEYFRAME_INTERVAL == 0;
+  }
+  /**
+   * The register data of the last frame for each tid since the last
+   * keyframe.
+   */
+  struct RegisterDeltaBase {
+    std::vector<uint8_t> regs;
+    std::vector<uint8_t> extra_regs;
+  };
+  std::unordered_map<pid_t, RegisterDeltaBase> register_delta_bases;
+
   // Directory into which we're saving the trace files.
   string trace_dir;
   // CPU core# that the tracees are bound to
@@ -289,6 +309,12 @@ public:
 
   TicksSemantics ticks_semantics() const { return ticks_semantics_; }
 
+  /**
+   * Total time recording has been blocked waiting for trace compression to
+   * catch up.
+   */
+  double compression_wait_seconds() const;
+
 private:
   bool try_hardlink_file(const std::string& real_file_name,
                          const std::string& access_file_name, std::string* new_name);
@@ -311,6 +337,8 @@ private:
    */
   std::map<std::pair<dev_t, ino_t>, std::string> files_assumed_immutable;
   std::vector<RawDataMetadata> raw_recs;
+  // Scratch space for write_frame's register deltas.
+  std::vector<uint8_t> register_delta;
   std::vector<CPUIDRecord> cpuid_records;
   TicksSemantics ticks_semantics_;
   // Keep the 'incomplete' (later renamed to 'version') file open until we
@@ -354,7 +382,7 @@ public:
    * the global time to match the time recorded in the trace
    * frame.
    */
-  TraceFrame read_frame();
+  TraceFrame read_frame() { return read_frame(READ); }
 
   /**
    * Read the next mapped region descriptor and return it.
@@ -405,6 +433,14 @@ public:
    */
   bool read_raw_data_metadata_for_frame(RawDataMetadata& d);
 
+  /**
+   * Return the raw data records for the last-read frame that haven't been
+   * read yet, in reverse order.
+   */
+  const std::vector<RawDataMetadata>& raw_data_metadata_for_frame() const {
+    return raw_recs;
+  }
+
   /**
    * Return true iff all trace files are "good".
    * for more details.
@@ -428,6 +464,24 @@ public:
    */
   void rewind();
 
+  /**
+   * Reposition all substreams so that the next read_frame() returns the
+   * frame at |time|. Requires a frame index (see TraceFrameIndex); returns
+   * false if there is none or |time| is not a frame of this trace.
+   */
+  bool seek_to_frame(FrameTime time);
+
+  /**
+   * Return the trace's frame index, or null if it doesn't have one.
+   */
+  const TraceFrameIndex* frame_index();
+
+  /**
+   * Return the current position in substream |s|, as an offset into
+   * its uncompressed data.
+   */
+  uint64_t substream_offset(Substream s) const { return reader(s).tell(); }
+
   uint64_t uncompressed_bytes() const;
   uint64_t compressed_bytes() const;
 
@@ -494,6 +548,10 @@ public:
   int required_forward_compatibility_version() const { return required_forward_compatibility_version_; }
 
 private:
+  enum ReadMode { READ, PEEK };
+  // PEEK leaves the register delta bases unchanged.
+  TraceFrame read_frame(ReadMode mode);
+
   CompressedReader& reader(Substream s) { return *readers[s]; }
   const CompressedReader& reader(Substream s) const { return *readers[s]; }
 
@@ -504,8 +562,10 @@ private:
   TicksSemantics ticks_semantics_;
   double monotonic_time_;
   std::unique_ptr<TraceUuid> uuid_;
+  std::shared_ptr<TraceFrameIndex> frame_index_;
   MemoryRange exclusion_range_;
   bool trace_uses_cpuid_faulting;
+  bool frame_index_loaded;
   bool preload_thread_locals_recorded_;
   bool clear_fip_fdp_;
   bool chaos_mode_known_;
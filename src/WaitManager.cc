@@ -21,6 +21,7 @@ class WaitState {
 public:
   WaitResult wait(const WaitOptions& options, int type);
   void poll_stops();
+  vector<pid_t> stopped_tids();
 protected:
   // Poll child(ren) for a wait status. If tid == -1 we wait for any child, otherwise
   // we wait for the specific child 'tid' (which may be more efficient, the kernel
@@ -182,6 +183,15 @@ void WaitState::poll_stops() {
   }
 }
 
+vector<pid_t> WaitState::stopped_tids() {
+  vector<pid_t> result;
+  result.reserve(stop_statuses.size());
+  for (auto& it : stop_statuses) {
+    result.push_back(it.first);
+  }
+  return result;
+}
+
 static WaitState& wait_state() {
   static WaitState static_state;
   return static_state;
@@ -218,4 +228,8 @@ void WaitManager::poll_stops() {
   wait_state().poll_stops();
 }
 
+vector<pid_t> WaitManager::stopped_tids() {
+  return wait_state().stopped_tids();
+}
+
 } // namespace rr
@@ -4,6 +4,7 @@
 #define RR_WAIT_MANAGER_H_
 
 #include <unordered_map>
+#include <vector>
 
 #include "WaitStatus.h"
 
@@ -89,6 +90,11 @@ public:
 
   // Gather stop notifications from all tasks without blocking.
   static void poll_stops();
+  // The tids that have a stop notification stashed in the WaitManager.
+  // Right after poll_stops() this is exactly the set of tracees that have
+  // stopped and not yet been waited for (unlike TraceeAttentionSet, which
+  // is only a hint).
+  static std::vector<pid_t> stopped_tids();
 };
 
 }
@@ -28,7 +28,10 @@ struct DecodedInstruction {
   int address_size;
   int length;
   bool modifies_flags;
+  // SI is only ever read.
   bool uses_si;
+  bool uses_di;
+  bool writes_di;
   bool is_repne;
 };
 
@@ -45,6 +48,8 @@ static bool decode_x86_string_instruction(const InstructionBuf& code,
 
   decoded->modifies_flags = false;
   decoded->uses_si = false;
+  decoded->uses_di = false;
+  decoded->writes_di = false;
   decoded->is_repne = false;
 
   int i;
@@ -72,23 +77,30 @@ static bool decode_x86_string_instruction(const InstructionBuf& code,
       case 0xA4: // MOVSB
       case 0xA5: // MOVSW
         decoded->uses_si = true;
+        decoded->uses_di = decoded->writes_di = true;
         done = true;
         break;
       case 0xAA: // STOSB
       case 0xAB: // STOSW
+        decoded->uses_di = decoded->writes_di = true;
+        done = true;
+        break;
       case 0xAC: // LODSB
       case 0xAD: // LODSW
+        decoded->uses_si = true;
         done = true;
         break;
       case 0xA6: // CMPSB
       case 0xA7: // CMPSW
         decoded->modifies_flags = true;
         decoded->uses_si = true;
+        decoded->uses_di = true;
         done = true;
         break;
       case 0xAE: // SCASB
       case 0xAF: // SCASW
         decoded->modifies_flags = true;
+        decoded->uses_di = true;
         done = true;
         break;
       default:
@@ -161,6 +173,78 @@ static void bound_iterations_for_watchpoint(Task* t, remote_ptr<void> reg,
   *iterations = min(*iterations, steps);
 }
 
+/**
+ * Maximum number of bytes of string operands we read from the tracee to
+ * predict where a CMPS/SCAS loop terminates.
+ */
+static const size_t MAX_TERMINATION_SCAN_BYTES = 64 * 1024;
+
+/**
+ * Read the |count| operands of size |size| starting at |reg| and moving in
+ * the direction given by DF, so that element k of |out| is the operand
+ * accessed by iteration k. Returns false if the memory can't be read.
+ */
+static bool read_string_operands(Task* t, remote_ptr<void> reg, int size,
+                                 uintptr_t count, vector<uint8_t>* out) {
+  size_t bytes = count * size;
+  out->resize(bytes);
+  remote_ptr<void> start =
+      t->regs().df_flag() ? reg - (bytes - size) : reg;
+  if (t->read_bytes_fallible(start, bytes, out->data()) != (ssize_t)bytes) {
+    return false;
+  }
+  if (t->regs().df_flag()) {
+    // Reverse the element order so that element 0 is at |reg|.
+    for (uintptr_t i = 0; i < count / 2; ++i) {
+      swap_ranges(out->begin() + i * size, out->begin() + (i + 1) * size,
+                  out->begin() + (count - 1 - i) * size);
+    }
+  }
+  return true;
+}
+
+/**
+ * For CMPS/SCAS, compute from the tracee's memory the number of iterations
+ * that can run before the iteration whose comparison result ends the loop,
+ * and bound |iterations| by it. This lets us stop right before the loop
+ * exits in a single pass. If the operands can't be read, |iterations| is
+ * left alone and the caller must detect the early exit after running.
+ */
+static void bound_iterations_for_termination(Task* t,
+                                             const DecodedInstruction& decoded,
+                                             uintptr_t* iterations) {
+  int size = decoded.operand_size;
+  // Examine one more element than we plan to execute, so that we notice
+  // when the loop would exit right after |*iterations| iterations.
+  uintptr_t count = min<uintptr_t>(*iterations + 1,
+                                   MAX_TERMINATION_SCAN_BYTES / size);
+  vector<uint8_t> di_operands;
+  if (!read_string_operands(t, t->regs().di(), size, count, &di_operands)) {
+    return;
+  }
+  vector<uint8_t> si_operands;
+  if (decoded.uses_si) {
+    if (!read_string_operands(t, t->regs().si(), size, count, &si_operands)) {
+      return;
+    }
+  }
+  uintptr_t ax = t->regs().ax();
+  for (uintptr_t k = 0; k < count; ++k) {
+    const uint8_t* other = decoded.uses_si
+                               ? si_operands.data() + k * size
+                               : reinterpret_cast<const uint8_t*>(&ax);
+    bool equal = memcmp(other, di_operands.data() + k * size, size) == 0;
+    if (equal == decoded.is_repne) {
+      // Iteration k ends the loop.
+      *iterations = min(*iterations, k);
+      return;
+    }
+  }
+  // The loop doesn't exit in the window we examined, so we can run
+  // through all but its last element.
+  *iterations = min(*iterations, count - 1);
+}
+
 FastForwardStatus fast_forward_through_instruction(Task* t, ResumeRequest how,
                                                    const vector<const Registers*>& states) {
   DEBUG_ASSERT(how == RESUME_SINGLESTEP || how == RESUME_SYSEMU_SINGLESTEP);
@@ -267,26 +351,36 @@ FastForwardStatus fast_forward_through_instruction(Task* t, ResumeRequest how,
       }
     }
 
-    // To stop before the ZF changes and we exit the loop, we don't bound
-    // the iterations here. Instead we run the loop, observe the ZF change,
-    // and then rerun the loop with the loop-exit state added to the |states|
-    // list. See below.
-
     // A code watchpoint would already be hit if we're going to hit it.
     // Check for data watchpoints that we might hit when reading/writing
-    // memory.
-    // Make conservative assumptions about the watchpoint type. Applying
-    // unnecessary watchpoints here will only result in a few more singlesteps.
-    // We do have to ignore SI if the instruction doesn't use it; otherwise
-    // a watchpoint which happens to match SI will appear to be hit on every
-    // iteration of the string instruction, which would be devastating.
+    // memory. SI is only read, so only read-write watchpoints can trigger
+    // on it; likewise DI unless the instruction writes through it.
+    // We do have to ignore SI and DI if the instruction doesn't use them;
+    // otherwise a watchpoint which happens to match them will appear to be
+    // hit on every iteration of the string instruction, which would be
+    // devastating.
     for (auto& watch : t->vm()->all_watchpoints()) {
-      if (decoded.uses_si) {
+      if (watch.type == WATCH_EXEC) {
+        continue;
+      }
+      bool read_triggers = watch.type == WATCH_READWRITE;
+      if (decoded.uses_si && read_triggers) {
         bound_iterations_for_watchpoint(t, t->regs().si(), decoded, watch,
                                         &iterations);
       }
-      bound_iterations_for_watchpoint(t, t->regs().di(), decoded, watch,
-                                      &iterations);
+      if (decoded.uses_di && (decoded.writes_di || read_triggers)) {
+        bound_iterations_for_watchpoint(t, t->regs().di(), decoded, watch,
+                                        &iterations);
+      }
+    }
+
+    // To stop before the ZF changes and we exit the loop, we compare the
+    // string operands ourselves to find the iteration that ends the loop.
+    // If we can't read them, we run the loop, observe the ZF change,
+    // and then rerun the loop with the loop-exit state added to the |states|
+    // list. See below.
+    if (decoded.modifies_flags && iterations > 0 && states_copy.empty()) {
+      bound_iterations_for_termination(t, decoded, &iterations);
     }
 
     if (iterations == 0) {
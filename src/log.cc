@@ -2,6 +2,7 @@
 
 #include "log.h"
 
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -95,6 +96,10 @@ static string simple_to_lower(const string& s) {
 
 static bool log_globals_initialized = false;
 static LogLevel default_level = LOG_error;
+// The most verbose level any module logs at, so that messages no module
+// would print can be dropped without taking log_lock or looking up their
+// module. Only updated on the main thread, like the levels themselves.
+static LogLevel max_enabled_level = LOG_error;
 
 // These need to be available to other static constructors, so we need to be
 // sure that they can be constant-initialized. Unfortunately some versions of
@@ -118,9 +123,27 @@ _CONSTANT_STATIC unique_ptr<deque<char>> log_buffer;
 _CONSTANT_STATIC ostream* log_file;
 // Maximum size of `log_buffer`.
 size_t log_buffer_size;
+// Serializes module lookups and message construction so that helper threads
+// (e.g. in `rr sources`) can log. Held from the start of an enabled message
+// until it's flushed; messages more verbose than max_enabled_level never
+// take it. Recursive because formatting a message can log.
+static pthread_mutex_t log_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
 
 static void flush_log_file() { log_file->flush(); }
 
+static void update_max_enabled_level() {
+  max_enabled_level = default_level;
+  for (auto& it : *level_map) {
+    max_enabled_level = max(max_enabled_level, it.second);
+  }
+}
+
+// False if no module can be logging at |level|. Before the globals are
+// initialized we don't know, so fall back to the locked lookup.
+static bool may_be_logging(LogLevel level) {
+  return !log_globals_initialized || level <= max_enabled_level;
+}
+
 static void init_log_globals();
 
 void apply_log_spec(const char *spec) {
@@ -153,6 +176,7 @@ void apply_log_spec(const char *spec) {
     } else {
       (*level_map)[n] = level;
     }
+    update_max_enabled_level();
     if (*end) {
       p = end + 1;
     } else {
@@ -260,11 +284,13 @@ void set_all_logging(LogLevel level) {
   default_level = level;
   level_map->clear();
   log_modules->clear();
+  update_max_enabled_level();
 }
 
 void set_logging(const char* name, LogLevel level) {
   (*level_map)[simple_to_lower(name)] = level;
   log_modules->clear();
+  update_max_enabled_level();
 }
 
 static const char* log_name(LogLevel level) {
@@ -342,17 +368,30 @@ static void write_prefix(T& stream, LogLevel level, const char* file, int line,
 }
 
 bool is_logging_enabled(LogLevel level, const char* file) {
+  if (!may_be_logging(level)) {
+    return false;
+  }
+  pthread_mutex_lock(&log_lock);
   LogModule& m = get_log_module(file);
-  return level <= m.level;
+  bool enabled = level <= m.level;
+  pthread_mutex_unlock(&log_lock);
+  return enabled;
 }
 
 NewlineTerminatingOstream::NewlineTerminatingOstream(LogLevel level,
                                                      const char* file, int line,
                                                      const char* function)
     : level(level) {
+  if (!may_be_logging(level)) {
+    enabled = false;
+    return;
+  }
+  pthread_mutex_lock(&log_lock);
   LogModule& m = get_log_module(file);
   enabled = level <= m.level;
-  if (enabled) {
+  if (!enabled) {
+    pthread_mutex_unlock(&log_lock);
+  } else {
     if (level == LOG_debug) {
       *this << "[" << m.name << "] ";
     } else {
@@ -366,12 +405,19 @@ NewlineTerminatingOstream::NewlineTerminatingOstream(LogModule** m_ptr,
                                                      const char* file, int line,
                                                      const char* function)
     : level(level) {
+  if (!may_be_logging(level)) {
+    enabled = false;
+    return;
+  }
+  pthread_mutex_lock(&log_lock);
   if (!*m_ptr) {
     *m_ptr = &get_log_module(file);
   }
   LogModule& m = **m_ptr;
   enabled = level <= m.level;
-  if (enabled) {
+  if (!enabled) {
+    pthread_mutex_unlock(&log_lock);
+  } else {
     if (level == LOG_debug) {
       *this << "[" << m.name << "] ";
     } else {
@@ -387,11 +433,14 @@ NewlineTerminatingOstream::~NewlineTerminatingOstream() {
     if (Flags::get().fatal_errors_and_warnings && level <= LOG_warn) {
       notifying_abort();
     }
+    pthread_mutex_unlock(&log_lock);
   }
 }
 
+// Fatal messages never release log_lock; the process is going away.
 CleanFatalOstream::CleanFatalOstream(const char* file, int line,
                                      const char* function) {
+  pthread_mutex_lock(&log_lock);
   errno = 0;
   write_prefix(*this, LOG_fatal, file, line, function);
 }
@@ -404,6 +453,7 @@ CleanFatalOstream::~CleanFatalOstream() {
 }
 
 FatalOstream::FatalOstream(const char* file, int line, const char* function) {
+  pthread_mutex_lock(&log_lock);
   write_prefix(*this, LOG_fatal, file, line, function);
 }
 
@@ -34,7 +34,9 @@ struct LogModule;
  * file extension (if any), and lowercasing any uppercase ASCII characters.
  * e.g. <rr-dir>/src/Task.cc becomes the log module "task".
  *
- * This logging infrastructure is not thread safe. Use only on the main thread.
+ * LOG and FATAL may be used from helper threads; messages are serialized.
+ * Everything else here (changing log levels, flushing the log buffer) must
+ * only be used on the main thread.
  */
 
 /**
@@ -0,0 +1,30 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Spawns many short-lived processes, like a build system does. Each one
+   execs this (dynamically linked) program again and exits immediately. */
+int main(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "child") == 0) {
+    return 0;
+  }
+  for (int i = 0; i < 2000; ++i) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      perror("fork");
+      return 1;
+    }
+    if (!pid) {
+      execl("/proc/self/exe", argv[0], "child", (char*)NULL);
+      _exit(1);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "child %d failed\n", pid);
+      return 1;
+    }
+  }
+  return 0;
+}
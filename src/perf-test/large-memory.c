@@ -0,0 +1,30 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* Heap size in MB; override with the first argument. */
+#define DEFAULT_SIZE_MB 512
+
+int main(int argc, char** argv) {
+  size_t size_mb = argc > 1 ? strtoul(argv[1], NULL, 0) : DEFAULT_SIZE_MB;
+  size_t size = size_mb << 20;
+  char* p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+  memset(p, 1, size);
+  /* Interleave some syscalls with touching the memory, so that replay
+     checkpoints have to deal with a large address space. */
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  for (size_t offset = 0; offset < size; offset += page_size * 256) {
+    p[offset] = 2;
+    getppid();
+  }
+  return 0;
+}
@@ -0,0 +1,21 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+int main(void) {
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  for (int i = 0; i < 50000; ++i) {
+    size_t size = page_size * (1 + i % 16);
+    char* p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+      perror("mmap");
+      return 1;
+    }
+    p[0] = 1;
+    mprotect(p, page_size, PROT_READ);
+    munmap(p, size);
+  }
+  return 0;
+}
@@ -0,0 +1,14 @@
+#include <signal.h>
+#include <stddef.h>
+
+static volatile int count;
+
+static void handler(__attribute__((unused)) int sig) { ++count; }
+
+int main(void) {
+  signal(SIGUSR1, handler);
+  for (int i = 0; i < 50000; ++i) {
+    raise(SIGUSR1);
+  }
+  return count == 50000 ? 0 : 1;
+}
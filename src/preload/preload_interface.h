@@ -106,10 +106,19 @@ static inline const char* extract_file_name(const char* s) {
 #define SYSCALLBUF_ENABLED_ENV_VAR "_RR_USE_SYSCALLBUF"
 
 /* Size of table mapping fd numbers to syscallbuf-disabled flag.
- * Most Linux kernels limit fds to 1024 so it probably doesn't make sense
- * to raise this value... */
+ * Fds from SYSCALLBUF_FDS_DISABLED_SIZE - 1 up to SYSCALLBUF_FDS_HI_LIMIT
+ * are covered by the syscallbuf_fds_traced bitmap instead. */
 #define SYSCALLBUF_FDS_DISABLED_SIZE 1024
 
+/* Fds below this limit (the kernel's default hard RLIMIT_NOFILE) get
+ * precise syscallbuf classification. Larger fds share the class in
+ * syscallbuf_fd_class[SYSCALLBUF_FDS_DISABLED_SIZE - 1]. */
+#define SYSCALLBUF_FDS_HI_LIMIT (1 << 20)
+/* One bit per fd. */
+#define SYSCALLBUF_FDS_TRACED_WORDS (SYSCALLBUF_FDS_HI_LIMIT / 64)
+/* One bit per word of syscallbuf_fds_traced. */
+#define SYSCALLBUF_FDS_TRACED_SUMMARY_WORDS (SYSCALLBUF_FDS_TRACED_WORDS / 64)
+
 #define MPROTECT_RECORD_COUNT 1000
 
 #if defined(__x86_64__) || defined(__i386__)
@@ -146,6 +155,8 @@ static inline const char* extract_file_name(const char* s) {
 
 /* Not ABI stable - in record page only */
 #define RR_PAGE_FF_BYTES RR_PAGE_BREAKPOINT_VALUE
+/* Not ABI stable - x86-64 and aarch64 only */
+#define RR_PAGE_SYSCALL_BATCH (RR_PAGE_FF_BYTES + 8)
 
 /* PRELOAD_THREAD_LOCALS_ADDR should not change.
  * Tools depend on this address. */
@@ -185,6 +196,12 @@ static inline const char* extract_file_name(const char* s) {
  * (rather than the first), which requires special handling.
  */
 #define PATCH_SYSCALL_INSTRUCTION_IS_LAST (1 << 1)
+/* The patch region is all NOPs, so the hook doesn't execute anything after
+ * the syscall. rr uses such a hook for syscalls whose following instructions
+ * don't match any hook, after relocating those instructions into the jump
+ * stub (x86-64 only).
+ */
+#define PATCH_IS_NOP_INSTRUCTIONS (1 << 2)
 
 /**
  * To support syscall buffering, we replace syscall instructions with a "call"
@@ -262,8 +279,10 @@ struct preload_globals {
    * Set by rr.
    * For each fd, indicate a class that is valid for all fds with the given
    * number in all tasks that share this address space. For fds >=
-   * SYSCALLBUF_FDS_DISABLED_SIZE - 1, the class is given by by
-   * syscallbuf_fd_class[SYSCALLBUF_FDS_DISABLED_SIZE - 1]. See the
+   * SYSCALLBUF_FDS_DISABLED_SIZE - 1, see syscallbuf_fds_traced below.
+   * QUIRK: In traces recorded before syscallbuf_fds_traced existed, the
+   * class for all fds >= SYSCALLBUF_FDS_DISABLED_SIZE - 1 is given by
+   * syscallbuf_fd_class[SYSCALLBUF_FDS_DISABLED_SIZE - 1].
    */
   VOLATILE char syscallbuf_fd_class[SYSCALLBUF_FDS_DISABLED_SIZE];
   /* mprotect records. Set by preload. */
@@ -284,6 +303,27 @@ struct preload_globals {
   unsigned char fdt_uniform;
   /* The CPU we're bound to, if any; -1 if not bound. */
   int32_t cpu_binding;
+  /**
+   * Set by rr.
+   * Two-level bitmap of fds in [SYSCALLBUF_FDS_DISABLED_SIZE - 1,
+   * SYSCALLBUF_FDS_HI_LIMIT) that must not be buffered (i.e. whose class is
+   * not FD_CLASS_UNTRACED), indexed by fd number. Bit N of
+   * syscallbuf_fds_traced_summary is set iff word N of syscallbuf_fds_traced
+   * is nonzero, so checking an untraced fd normally touches only the
+   * summary, and the pages of the full bitmap stay unpopulated.
+   * Fds >= SYSCALLBUF_FDS_HI_LIMIT use
+   * syscallbuf_fd_class[SYSCALLBUF_FDS_DISABLED_SIZE - 1].
+   */
+  VOLATILE uint64_t
+      syscallbuf_fds_traced_summary[SYSCALLBUF_FDS_TRACED_SUMMARY_WORDS];
+  VOLATILE uint64_t syscallbuf_fds_traced[SYSCALLBUF_FDS_TRACED_WORDS];
+  /**
+   * Set by rr.
+   * Bitmap of fds in the same range whose class is FD_CLASS_PROC_MEM. Only
+   * consulted for fds whose syscallbuf_fds_traced bit is set; those are
+   * FD_CLASS_TRACED unless their bit is set here.
+   */
+  VOLATILE uint64_t syscallbuf_fds_proc_mem[SYSCALLBUF_FDS_TRACED_WORDS];
 };
 
 /**
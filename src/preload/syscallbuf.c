@@ -749,7 +749,7 @@ static void __attribute__((constructor)) init_process(void) {
       { 0x3d, 0x01, 0xf0, 0xff, 0xff },
       (uintptr_t)_syscall_hook_trampoline_3d_01_f0_ff_ff },
     /* Our vdso syscall patch has 'int 80' followed by onp; nop; nop */
-    { PATCH_IS_MULTIPLE_INSTRUCTIONS,
+    { PATCH_IS_MULTIPLE_INSTRUCTIONS | PATCH_IS_NOP_INSTRUCTIONS,
       3,
       { 0x90, 0x90, 0x90 },
       (uintptr_t)_syscall_hook_trampoline_90_90_90 }
@@ -866,7 +866,7 @@ static void __attribute__((constructor)) init_process(void) {
       (uintptr_t)_syscall_hook_trampoline_89_c2_f7_da },
     /* Our VDSO vsyscall patches have 'syscall' followed by "nop; nop;
        nop" */
-    { PATCH_IS_MULTIPLE_INSTRUCTIONS,
+    { PATCH_IS_MULTIPLE_INSTRUCTIONS | PATCH_IS_NOP_INSTRUCTIONS,
       3,
       { 0x90, 0x90, 0x90 },
       (uintptr_t)_syscall_hook_trampoline_90_90_90 },
@@ -1136,10 +1136,23 @@ static enum syscallbuf_fd_classes fd_class(int fd) {
   if (fd < 0) {
     return FD_CLASS_INVALID;
   }
-  if (fd >= SYSCALLBUF_FDS_DISABLED_SIZE - 1) {
-    fd = SYSCALLBUF_FDS_DISABLED_SIZE - 1;
+  if (fd < SYSCALLBUF_FDS_DISABLED_SIZE - 1) {
+    return globals.syscallbuf_fd_class[fd];
+  }
+  if (fd < SYSCALLBUF_FDS_HI_LIMIT) {
+    int word = fd / 64;
+    if (!(globals.syscallbuf_fds_traced_summary[word / 64] &
+          ((uint64_t)1 << (word % 64)))) {
+      return FD_CLASS_UNTRACED;
+    }
+    uint64_t bit = (uint64_t)1 << (fd % 64);
+    if (!(globals.syscallbuf_fds_traced[word] & bit)) {
+      return FD_CLASS_UNTRACED;
+    }
+    return (globals.syscallbuf_fds_proc_mem[word] & bit) ? FD_CLASS_PROC_MEM
+                                                         : FD_CLASS_TRACED;
   }
-  return globals.syscallbuf_fd_class[fd];
+  return globals.syscallbuf_fd_class[SYSCALLBUF_FDS_DISABLED_SIZE - 1];
 }
 
 static int is_bufferable_fd(int fd) {
@@ -0,0 +1,35 @@
+/* -*- Mode: C; tab-width: 8; c-basic-offset: 2; indent-tabs-mode: nil; -*- */
+
+#include "util.h"
+
+#define ROUNDS 12
+#define DIRTY_SIZE (4 * 1024 * 1024)
+/* Enough buffered syscalls per round to space reverse-exec checkpoints
+   between rounds. */
+#define SYSCALLS_PER_ROUND 15000
+
+static char dirty[DIRTY_SIZE];
+static volatile int round_number;
+
+static void round_done(void) {}
+
+static void breakpoint(void) {}
+
+int main(void) {
+  struct rusage ru;
+  int i;
+
+  for (round_number = 0; round_number < ROUNDS; ++round_number) {
+    /* Every checkpoint taken before this has DIRTY_SIZE bytes of private
+       memory afterwards. */
+    memset(dirty, round_number + 1, sizeof(dirty));
+    for (i = 0; i < SYSCALLS_PER_ROUND; ++i) {
+      test_assert(0 == getrusage(RUSAGE_SELF, &ru));
+    }
+    round_done();
+  }
+  breakpoint();
+
+  atomic_puts("EXIT-SUCCESS");
+  return 0;
+}
@@ -0,0 +1,16 @@
+from util import *
+
+send_gdb('break breakpoint')
+expect_gdb('Breakpoint 1')
+send_gdb('c')
+expect_gdb('Breakpoint 1')
+
+# Reverse execution still works from the checkpoints that survived eviction.
+send_gdb('break round_done')
+expect_gdb('Breakpoint 2')
+send_gdb('reverse-cont')
+expect_gdb('Breakpoint 2')
+send_gdb('p round_number')
+expect_gdb('= 11')
+
+ok()
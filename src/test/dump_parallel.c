@@ -0,0 +1,22 @@
+/* -*- Mode: C; tab-width: 8; c-basic-offset: 2; indent-tabs-mode: nil; -*- */
+
+#include "util.h"
+
+/* Each call is an unbuffered syscall that writes |ts|, recorded as two
+   frames, so this produces enough frames for rr dump to split an indexed
+   trace between threads. */
+#define NUM_SYSCALLS 20000
+
+static struct timespec ts;
+
+int main(void) {
+  int i;
+
+  atomic_printf("buf=%p\n", &ts);
+  for (i = 0; i < NUM_SYSCALLS; ++i) {
+    test_assert(0 == syscall(SYS_clock_getres, CLOCK_MONOTONIC, &ts));
+  }
+
+  atomic_puts("EXIT-SUCCESS");
+  return 0;
+}
@@ -0,0 +1,43 @@
+/* -*- Mode: C; tab-width: 8; c-basic-offset: 2; indent-tabs-mode: nil; -*- */
+
+#include "util.h"
+
+#define NUM_RANGES 8
+
+int main(void) {
+  char* pages;
+  pid_t pid;
+  int status;
+  int i;
+
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  pages = mmap(NULL, page_size * NUM_RANGES * 2, PROT_READ | PROT_WRITE,
+               MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  test_assert(pages != MAP_FAILED);
+
+  /* Make every other page DONTFORK so rr has to unmap several separate
+     ranges in the child during replay. */
+  for (i = 0; i < NUM_RANGES; ++i) {
+    char* p = pages + page_size * i * 2;
+    test_assert(0 == madvise(p, page_size, MADV_DONTFORK));
+    p[0] = 1;
+    p[page_size] = 2;
+  }
+
+  pid = fork();
+  if (!pid) {
+    for (i = 0; i < NUM_RANGES; ++i) {
+      char* p = pages + page_size * i * 2;
+      test_assert(-1 == madvise(p, page_size, MADV_NORMAL));
+      test_assert(ENOMEM == errno);
+      test_assert(p[page_size] == 2);
+    }
+    return 77;
+  }
+
+  test_assert(pid == wait(&status));
+  test_assert(WIFEXITED(status) && WEXITSTATUS(status) == 77);
+
+  atomic_puts("EXIT-SUCCESS");
+  return 0;
+}
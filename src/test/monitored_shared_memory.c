@@ -0,0 +1,40 @@
+/* -*- Mode: C; tab-width: 8; c-basic-offset: 2; indent-tabs-mode: nil; -*- */
+
+#include "util.h"
+
+#define NUM_PAGES 4
+
+int main(int argc, __attribute__((unused)) char* argv[]) {
+  int fd;
+  volatile char* p;
+  int count = 0;
+  size_t page_size = sysconf(_SC_PAGESIZE);
+
+  fd = open("monitored_shm_segment", O_CREAT | O_RDWR, 0600);
+  test_assert(fd >= 0);
+  test_assert(0 == ftruncate(fd, NUM_PAGES * page_size));
+  p = (char*)mmap(NULL, NUM_PAGES * page_size,
+                  PROT_READ | (argc == 2 ? PROT_WRITE : 0), MAP_SHARED, fd, 0);
+  test_assert(MAP_FAILED != p);
+
+  if (argc == 2) {
+    /* Update two non-adjacent pages, writing the flag page last. */
+    p[page_size + 7] = 2;
+    p[3 * page_size] = 1;
+    test_assert(0 == unlink("monitored_shm_segment"));
+    return 0;
+  }
+
+  atomic_puts("ready");
+  while (p[3 * page_size] == 0) {
+    ++count;
+    sched_yield();
+  }
+  test_assert(p[page_size + 7] == 2);
+  test_assert(p[0] == 0);
+  test_assert(p[2 * page_size] == 0);
+
+  atomic_printf("Count = %d\n", count);
+  atomic_puts("EXIT-SUCCESS");
+  return 0;
+}
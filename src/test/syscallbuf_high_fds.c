@@ -0,0 +1,74 @@
+/* -*- Mode: C; tab-width: 8; c-basic-offset: 2; indent-tabs-mode: nil; -*- */
+
+#include "util.h"
+
+#define STDOUT_DUP_FD 4000
+#define DEV_ZERO_FD 3000
+#define PROC_MEM_FD 3500
+#define NUM_BUFFERED 100
+
+static volatile int target;
+
+int main(void) {
+  struct rlimit limit;
+  int ret = getrlimit(RLIMIT_NOFILE, &limit);
+  int fd;
+  int i;
+  char buf[16];
+  int value;
+  static const char msg[] = "Written to high fd\n";
+  test_assert(ret >= 0);
+
+  if (limit.rlim_max <= STDOUT_DUP_FD) {
+    atomic_puts("Hard fd limit too low, skipping test");
+    atomic_puts("EXIT-SUCCESS");
+    return 0;
+  }
+  if (limit.rlim_cur <= STDOUT_DUP_FD) {
+    limit.rlim_cur = STDOUT_DUP_FD + 1;
+    ret = setrlimit(RLIMIT_NOFILE, &limit);
+    test_assert(ret >= 0);
+  }
+
+  /* stdout is monitored by rr, so writes through its dup must stay traced
+     for the output to be replayed. */
+  ret = dup2(STDOUT_FILENO, STDOUT_DUP_FD);
+  test_assert(ret == STDOUT_DUP_FD);
+  ret = write(STDOUT_DUP_FD, msg, sizeof(msg) - 1);
+  test_assert(ret == sizeof(msg) - 1);
+
+  /* An unmonitored high fd can use the syscallbuf. */
+  fd = open("/dev/zero", O_RDONLY);
+  test_assert(fd >= 0);
+  ret = dup2(fd, DEV_ZERO_FD);
+  test_assert(ret == DEV_ZERO_FD);
+  for (i = 0; i < NUM_BUFFERED; ++i) {
+    ret = read(DEV_ZERO_FD, buf, sizeof(buf));
+    test_assert(ret == sizeof(buf));
+  }
+
+  /* A high /proc/self/mem fd keeps its class, so its pwrites are buffered
+     and replayed. */
+  fd = open("/proc/self/mem", O_RDWR);
+  test_assert(fd >= 0);
+  ret = dup2(fd, PROC_MEM_FD);
+  test_assert(ret == PROC_MEM_FD);
+  test_assert(0 == close(fd));
+  for (i = 0; i < NUM_BUFFERED; ++i) {
+    value = i + 1;
+    ret = pwrite(PROC_MEM_FD, &value, sizeof(value), (uintptr_t)&target);
+    test_assert(ret == sizeof(value));
+    test_assert(target == i + 1);
+  }
+
+  /* Closing the dup makes its number untraced again. */
+  ret = close(STDOUT_DUP_FD);
+  test_assert(ret == 0);
+  ret = dup2(DEV_ZERO_FD, STDOUT_DUP_FD);
+  test_assert(ret == STDOUT_DUP_FD);
+  ret = read(STDOUT_DUP_FD, buf, sizeof(buf));
+  test_assert(ret == sizeof(buf));
+
+  atomic_puts("EXIT-SUCCESS");
+  return 0;
+}
@@ -0,0 +1,18 @@
+/* -*- Mode: C; tab-width: 8; c-basic-offset: 2; indent-tabs-mode: nil; -*- */
+
+#include "util.h"
+
+#define NUM_SYSCALLS 1000
+
+int main(void) {
+  struct rusage ru;
+  int i;
+
+  /* getrusage is buffered, so these all end up in a few syscallbuf flushes. */
+  for (i = 0; i < NUM_SYSCALLS; ++i) {
+    test_assert(0 == getrusage(RUSAGE_SELF, &ru));
+  }
+
+  atomic_puts("EXIT-SUCCESS");
+  return 0;
+}
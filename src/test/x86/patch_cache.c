@@ -0,0 +1,40 @@
+/* -*- Mode: C; tab-width: 8; c-basic-offset: 2; indent-tabs-mode: nil; -*- */
+
+#include "util.h"
+
+static void do_syscalls(void) {
+  char buf[16];
+  struct timespec ts;
+  int fds[2];
+  int fd;
+  int i;
+
+  for (i = 0; i < 10; ++i) {
+    fd = open("/dev/zero", O_RDONLY);
+    test_assert(fd >= 0);
+    test_assert(read(fd, buf, sizeof(buf)) == sizeof(buf));
+    test_assert(0 == close(fd));
+
+    test_assert(0 == pipe(fds));
+    test_assert(write(fds[1], buf, sizeof(buf)) == sizeof(buf));
+    test_assert(read(fds[0], buf, sizeof(buf)) == sizeof(buf));
+    test_assert(0 == close(fds[0]));
+    test_assert(0 == close(fds[1]));
+
+    test_assert(0 == clock_gettime(CLOCK_MONOTONIC, &ts));
+    test_assert(getppid() > 0);
+  }
+}
+
+int main(int argc, char** argv) {
+  do_syscalls();
+  if (argc == 1) {
+    /* The new image maps the same binaries, so sites patched above can be
+       patched up front in it. */
+    execl(argv[0], argv[0], "exec", NULL);
+    test_assert(0 && "exec failed");
+  }
+
+  atomic_puts("EXIT-SUCCESS");
+  return 0;
+}
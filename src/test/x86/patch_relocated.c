@@ -0,0 +1,65 @@
+/* -*- Mode: C; tab-width: 8; c-basic-offset: 2; indent-tabs-mode: nil; -*- */
+
+#include "util.h"
+
+#if defined(__i386__)
+/* Don't do anything for 32 bit. */
+#elif defined(__x86_64__)
+/* No syscall hook matches the instructions after these syscalls, so rr
+   has to relocate them into the jump stub to patch the syscalls. */
+static const uint8_t rip_relative_code[] = {
+  0x0f, 0x05,                               /* syscall */
+  0x48, 0x8b, 0x0d, 0x07, 0x00, 0x00, 0x00, /* mov 0x7(%rip),%rcx */
+  0x48, 0x01, 0xc8,                         /* add %rcx,%rax */
+  0xc3,                                     /* ret */
+  0x90, 0x90, 0x90,                         /* nop; nop; nop */
+  0x0d, 0xf0, 0xad, 0x0b, 0x00, 0x00, 0x00, 0x00 /* .quad 0xbadf00d */
+};
+static const uint8_t branch_code[] = {
+  0x0f, 0x05,       /* syscall */
+  0x85, 0xc0,       /* test %eax,%eax */
+  0x79, 0x03,       /* jns 1f */
+  0x48, 0xf7, 0xd8, /* neg %rax */
+  0xc3,             /* 1: ret */
+};
+
+static long do_call(uint8_t* p, long syscallno, long arg1, long arg2) {
+  long ret;
+  __asm__ __volatile__("sub $128,%%rsp\n\t"
+                       "call *%4\n\t"
+                       "add $128,%%rsp\n\t"
+                       : "=a"(ret)
+                       : "a"(syscallno), "D"(arg1), "S"(arg2), "r"(p)
+                       : "rcx", "r11", "memory");
+  return ret;
+}
+
+static void check_patch(uint8_t* p) { test_assert(p[0] == 0xe9); }
+#else
+#error unsupported arch
+#endif
+
+int main(void) {
+#ifdef __x86_64__
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  uint8_t* p = mmap(NULL, page_size * 2, PROT_READ | PROT_WRITE,
+                    MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  pid_t pid = getpid();
+  int i;
+  test_assert(p != MAP_FAILED);
+  memcpy(p, rip_relative_code, sizeof(rip_relative_code));
+  memcpy(p + page_size, branch_code, sizeof(branch_code));
+  test_assert(0 == mprotect(p, page_size * 2, PROT_READ | PROT_EXEC));
+
+  for (i = 0; i < 2; ++i) {
+    test_assert(do_call(p, SYS_getpid, 0, 0) == pid + 0xbadf00d);
+    test_assert(do_call(p + page_size, SYS_getpid, 0, 0) == pid);
+    test_assert(do_call(p + page_size, SYS_kill, pid, -1) == EINVAL);
+  }
+  // If run outside of rr, we should die here.
+  check_patch(p);
+  check_patch(p + page_size);
+#endif
+  atomic_puts("EXIT-SUCCESS");
+  return 0;
+}
@@ -0,0 +1,45 @@
+/* -*- Mode: C; tab-width: 8; c-basic-offset: 2; indent-tabs-mode: nil; -*- */
+
+#include "util.h"
+
+#define SIZE 100000
+#define MISMATCH 60000
+
+static uintptr_t my_memcmp(char* a, char* b, uintptr_t size) {
+#if defined(__i386__) || defined(__x86_64__)
+  uintptr_t remaining;
+  __asm__ __volatile__("repe cmpsb\n\t"
+                       : "=c"(remaining), "+S"(a), "+D"(b)
+                       : "0"(size)
+                       : "cc", "memory");
+  return remaining;
+#else
+  uintptr_t i;
+  for (i = 0; i < size; ++i) {
+    if (a[i] != b[i]) {
+      return size - i - 1;
+    }
+  }
+  return 0;
+#endif
+}
+
+int main(void) {
+  char* a = (char*)mmap(NULL, SIZE, PROT_READ | PROT_WRITE,
+                        MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  char* b = (char*)mmap(NULL, SIZE, PROT_READ | PROT_WRITE,
+                        MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  uintptr_t remaining;
+  test_assert(a != MAP_FAILED && b != MAP_FAILED);
+
+  memset(a, 'x', SIZE);
+  memset(b, 'x', SIZE);
+  b[MISMATCH] = 'y';
+
+  atomic_printf("Buffers are at %p %p\n", a, b);
+  remaining = my_memcmp(a, b, SIZE);
+  test_assert(remaining == SIZE - MISMATCH - 1);
+
+  atomic_puts("EXIT-SUCCESS");
+  return 0;
+}
@@ -0,0 +1,25 @@
+from util import *
+import re
+
+send_gdb('b my_memcmp')
+expect_gdb('Breakpoint 1')
+send_gdb('c')
+expect_gdb(re.compile(r'Buffers are at ([^ \n]+) ([^ \n]+)'))
+a = eval(last_match().group(1));
+b = eval(last_match().group(2));
+expect_gdb('Breakpoint 1')
+
+# CMPS only reads memory, so this must not fire.
+send_gdb('watch -l *(char*)%d'%(b + 30000))
+expect_gdb('atchpoint 2')
+send_gdb('awatch -l *(char*)%d'%(a + 50000))
+expect_gdb('atchpoint 3')
+
+send_gdb('c')
+expect_gdb('atchpoint 3')
+
+send_gdb('delete 3')
+send_gdb('c')
+expect_gdb('exited normally')
+
+ok()
@@ -420,6 +420,14 @@ static bool is_task_buffer(const AddressSpace& as,
   return false;
 }
 
+static bool same_mapping(const KernelMapping& a, const KernelMapping& b) {
+  return a.start() == b.start() && a.end() == b.end() &&
+         a.prot() == b.prot() && a.flags() == b.flags() &&
+         a.device() == b.device() && a.inode() == b.inode() &&
+         a.file_offset_bytes() == b.file_offset_bytes() &&
+         a.fsname() == b.fsname();
+}
+
 struct ParsedChecksumLine {
   remote_ptr<void> start;
   remote_ptr<void> end;
@@ -476,6 +484,7 @@ static void iterate_checksums(Task* t, ChecksumMode mode,
     }
   }
 
+  map<remote_ptr<void>, AddressSpace::CachedChecksum> new_cached_checksums;
   auto checksum_iter = checksums.begin();
   for (auto it = as.maps().begin(); it != as.maps().end(); ++it) {
     AddressSpace::Mapping m = *it;
@@ -526,6 +535,30 @@ static void iterate_checksums(Task* t, ChecksumMode mode,
       }
     }
 
+    // Private anonymous memory that no page has been written to since the
+    // last checksum pass can't have changed, so reuse its old checksum.
+    // This avoids reading all of a large, mostly-idle heap every time.
+    bool cacheable = !(m.map.flags() & MAP_SHARED) &&
+                     ((m.map.flags() & MAP_ANONYMOUS) || !m.map.inode()) &&
+                     !(m.flags & AddressSpace::Mapping::IS_SYSCALLBUF) &&
+                     !m.local_addr;
+    auto cached = cacheable ? as.cached_checksums().find(m.map.start())
+                            : as.cached_checksums().end();
+    if (cached != as.cached_checksums().end() &&
+        same_mapping(cached->second.map, m.map) &&
+        !as.may_have_changed_since_clear_soft_dirty(t, m.map)) {
+      LOG(debug) << "Reusing checksum for unmodified " << m.map;
+      uint32_t checksum = cached->second.checksum;
+      if (STORE_CHECKSUMS == mode) {
+        fprintf(c.checksums_file, "(%x) %s\n", checksum, raw_map_line.c_str());
+      } else if (checksum != rec_checksum) {
+        notify_checksum_error(static_cast<ReplayTask*>(t), c.global_time,
+                              checksum, rec_checksum, raw_map_line.c_str());
+      }
+      new_cached_checksums.insert(*cached);
+      continue;
+    }
+
     vector<uint8_t> mem;
     mem.resize(m.map.size());
     memset(mem.data(), 0, mem.size());
@@ -561,6 +594,10 @@ static void iterate_checksums(Task* t, ChecksumMode mode,
     }
 
     uint32_t checksum = compute_checksum(mem.data(), mem.size());
+    if (cacheable) {
+      new_cached_checksums.insert(
+          make_pair(m.map.start(), AddressSpace::CachedChecksum{ m.map, checksum }));
+    }
 
     if (STORE_CHECKSUMS == mode) {
       fprintf(c.checksums_file, "(%x) %s\n", checksum, raw_map_line.c_str());
@@ -580,6 +617,14 @@ static void iterate_checksums(Task* t, ChecksumMode mode,
     t->write_mem(in_replay_flag, (unsigned char)1);
   }
 
+  // Start a new soft-dirty interval so that next time we know which
+  // mappings were written in between.
+  if (as.clear_soft_dirty(t)) {
+    as.cached_checksums() = std::move(new_cached_checksums);
+  } else {
+    as.cached_checksums().clear();
+  }
+
   fclose(c.checksums_file);
 }
 
@@ -1292,6 +1337,28 @@ string resource_path() {
   return resource_path;
 }
 
+string rr_cache_dir(const char* subdir) {
+  string dir;
+  const char* xdg_cache = getenv("XDG_CACHE_HOME");
+  if (xdg_cache && xdg_cache[0] == '/') {
+    dir = xdg_cache;
+  } else {
+    const char* home = getenv("HOME");
+    if (!home || home[0] != '/') {
+      return string();
+    }
+    dir = string(home) + "/.cache";
+  }
+  for (const char* component : { "", "/rr/", subdir }) {
+    dir += component;
+    if (mkdir(dir.c_str(), 0700) < 0 && errno != EEXIST) {
+      LOG(warn) << "Can't create " << dir;
+      return string();
+    }
+  }
+  return dir;
+}
+
 /**
  * Get the current time from the preferred monotonic clock in units of
  * seconds, relative to an unspecific point in the past.
@@ -1379,6 +1446,37 @@ vector<string> read_proc_status_fields(pid_t tid, const char* name,
   return result;
 }
 
+static uint64_t sum_private_memory_fields(FILE* f) {
+  char buf[1000];
+  uint64_t kb = 0;
+  while (fgets(buf, sizeof(buf), f)) {
+    unsigned long long value;
+    if (sscanf(buf, "Private_Clean: %llu kB", &value) == 1 ||
+        sscanf(buf, "Private_Dirty: %llu kB", &value) == 1) {
+      kb += value;
+    }
+  }
+  return kb * 1024;
+}
+
+uint64_t read_proc_private_memory_size(pid_t tid) {
+  char buf[100];
+  sprintf(buf, "/proc/%d/smaps_rollup", tid);
+  FILE* f = fopen(buf, "r");
+  if (!f) {
+    // smaps_rollup is only available in kernels >= 4.14. Fall back to
+    // summing the per-mapping entries.
+    sprintf(buf, "/proc/%d/smaps", tid);
+    f = fopen(buf, "r");
+    if (!f) {
+      return 0;
+    }
+  }
+  uint64_t result = sum_private_memory_fields(f);
+  fclose(f);
+  return result;
+}
+
 static bool check_for_pax_kernel() {
   auto results = read_proc_status_fields(getpid(), "PaX");
   return !results.empty();
@@ -2418,6 +2516,47 @@ bool coredumping_signal_takes_down_entire_vm() {
   return coredumping_signal_vm_behavior > 0;
 }
 
+static bool own_page_soft_dirty(int pagemap_fd, void* p) {
+  uint64_t entry;
+  off_t offset = (uintptr_t(p) / page_size()) * sizeof(entry);
+  return pread(pagemap_fd, &entry, sizeof(entry), offset) == sizeof(entry) &&
+         (entry & PAGEMAP_SOFT_DIRTY);
+}
+
+bool soft_dirty_works() {
+  static int soft_dirty_ok = -1;
+  if (soft_dirty_ok >= 0) {
+    return soft_dirty_ok;
+  }
+  // Kernels without CONFIG_MEM_SOFT_DIRTY accept the clear_refs write but
+  // never set the bit, so actually try it. Do this in a child so that rr
+  // doesn't take write faults on all its own pages afterwards.
+  pid_t child = fork();
+  if (child == 0) {
+    char* p = static_cast<char*>(mmap(NULL, page_size(), PROT_READ | PROT_WRITE,
+                                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    int clear_refs_fd = open("/proc/self/clear_refs", O_WRONLY);
+    int pagemap_fd = open("/proc/self/pagemap", O_RDONLY);
+    if (p == MAP_FAILED || clear_refs_fd < 0 || pagemap_fd < 0) {
+      _exit(1);
+    }
+    *(volatile char*)p = 1;
+    if (write(clear_refs_fd, "4", 1) != 1 ||
+        own_page_soft_dirty(pagemap_fd, p)) {
+      _exit(1);
+    }
+    *(volatile char*)p = 2;
+    _exit(own_page_soft_dirty(pagemap_fd, p) ? 0 : 1);
+  }
+
+  DEBUG_ASSERT(child > 0);
+  WaitResult result = WaitManager::wait_exit(WaitOptions(child));
+  soft_dirty_ok = result.code == WAIT_OK && result.status.exit_code() == 0;
+  LOG(debug) << "Soft-dirty page tracking "
+             << (soft_dirty_ok ? "works" : "not supported");
+  return soft_dirty_ok;
+}
+
 int parse_tid_from_proc_path(const std::string& pathname,
                              const std::string& property) {
   // XXX When rr becomes c++17 - use string view instead. Has better API for
@@ -256,6 +256,17 @@ std::vector<CPUIDRecord> all_cpuid_records();
  */
 bool cpuid_faulting_works();
 
+/**
+ * Returns true if the kernel maintains soft-dirty page bits, i.e. writing
+ * 4 to /proc/<pid>/clear_refs clears them and bit 55 of /proc/<pid>/pagemap
+ * entries reports pages written since.
+ */
+bool soft_dirty_works();
+
+// Set in a /proc/<pid>/pagemap entry if the page was written since the
+// soft-dirty bits were last cleared.
+const uint64_t PAGEMAP_SOFT_DIRTY = 1ULL << 55;
+
 /**
  * Locate a CPUID record for the give parameters, or return nullptr if there
  * isn't one.
@@ -310,6 +321,13 @@ std::string real_path(const std::string& path);
 
 std::string resource_path();
 
+/**
+ * Returns the directory $XDG_CACHE_HOME/rr/<subdir> (defaulting to
+ * $HOME/.cache/rr/<subdir>), creating it if necessary. Returns an empty
+ * string if there's no usable cache directory.
+ */
+std::string rr_cache_dir(const char* subdir);
+
 /**
  * Get the current time from the preferred monotonic clock in units of
  * seconds, relative to an unspecific point in the past.
@@ -324,6 +342,15 @@ std::vector<std::string> read_proc_status_fields(pid_t tid, const char* name,
                                                  const char* name2 = nullptr,
                                                  const char* name3 = nullptr);
 
+/**
+ * Returns the number of bytes of memory mapped only by the process
+ * containing |tid| (the sum of Private_Clean and Private_Dirty in
+ * /proc/<tid>/smaps_rollup). Pages still shared copy-on-write with
+ * other processes are not counted. Returns 0 if the information is
+ * unavailable.
+ */
+uint64_t read_proc_private_memory_size(pid_t tid);
+
 /**
  * Mainline Linux kernels use an invisible (to /proc/<pid>/maps) guard page
  * for stacks. grsecurity kernels don't.